@@ -0,0 +1,108 @@
+#include "allocation_guard.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace LLAP {
+
+#if LLAP_ALLOCATION_GUARD
+	static thread_local AllocationCounts thread_counts;
+	static std::atomic<size_t> process_count{ 0 };
+	static std::atomic<size_t> process_bytes{ 0 };
+
+	static void count_allocation(size_t size) {
+		thread_counts.count++;
+		thread_counts.bytes += size;
+		process_count.fetch_add(1, std::memory_order_relaxed);
+		process_bytes.fetch_add(size, std::memory_order_relaxed);
+	}
+
+	AllocationCounts thread_allocations() {
+		return thread_counts;
+	}
+
+	AllocationCounts process_allocations() {
+		AllocationCounts counts;
+		counts.count = process_count.load(std::memory_order_relaxed);
+		counts.bytes = process_bytes.load(std::memory_order_relaxed);
+		return counts;
+	}
+#else
+	AllocationCounts thread_allocations() {
+		return {};
+	}
+
+	AllocationCounts process_allocations() {
+		return {};
+	}
+#endif
+
+}
+
+#if LLAP_ALLOCATION_GUARD
+
+static void* counted_allocate(size_t size) {
+	LLAP::count_allocation(size);
+	void* memory = std::malloc(size != 0 ? size : 1);
+	if (memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+static void* counted_allocate(size_t size, std::align_val_t alignment) {
+	LLAP::count_allocation(size);
+	size_t align = static_cast<size_t>(alignment);
+	size_t padded = (size + align - 1) / align * align;
+#ifdef _WIN32
+	void* memory = _aligned_malloc(padded != 0 ? padded : align, align);
+#else
+	void* memory = std::aligned_alloc(align, padded != 0 ? padded : align);
+#endif
+	if (memory == nullptr) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+static void counted_free(void* memory, std::align_val_t) {
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	std::free(memory);
+#endif
+}
+
+void* operator new(size_t size) { return counted_allocate(size); }
+void* operator new[](size_t size) { return counted_allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_allocate(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_allocate(size, alignment); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	try { return counted_allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	try { return counted_allocate(size); } catch (...) { return nullptr; }
+}
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	try { return counted_allocate(size, alignment); } catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	try { return counted_allocate(size, alignment); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t alignment) noexcept { counted_free(memory, alignment); }
+void operator delete[](void* memory, std::align_val_t alignment) noexcept { counted_free(memory, alignment); }
+void operator delete(void* memory, size_t, std::align_val_t alignment) noexcept { counted_free(memory, alignment); }
+void operator delete[](void* memory, size_t, std::align_val_t alignment) noexcept { counted_free(memory, alignment); }
+void operator delete(void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept { counted_free(memory, alignment); }
+void operator delete[](void* memory, std::align_val_t alignment, const std::nothrow_t&) noexcept { counted_free(memory, alignment); }
+
+#endif
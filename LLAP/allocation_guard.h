@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+// Counting replacements of the global operator new are compiled into debug
+// builds, and into release builds with LLAP_BENCH defined. MSVC defines
+// _DEBUG with the debug runtime, the release configurations don't set NDEBUG.
+#if defined(_DEBUG) || defined(LLAP_BENCH)
+#define LLAP_ALLOCATION_GUARD 1
+#else
+#define LLAP_ALLOCATION_GUARD 0
+#endif
+
+namespace LLAP {
+
+	struct AllocationCounts {
+		size_t count = 0;
+		size_t bytes = 0;
+	};
+
+	// Heap allocations made through operator new, zero when the guard is compiled out
+	AllocationCounts thread_allocations(); // By the calling thread since it started
+	AllocationCounts process_allocations();
+
+	constexpr bool allocation_guard_enabled() {
+		return LLAP_ALLOCATION_GUARD != 0;
+	}
+
+}
@@ -0,0 +1,466 @@
+#include "allocator.h"
+
+#include <algorithm>
+
+namespace LLAP {
+
+	uint32_t find_memory_type(
+		const VkPhysicalDeviceMemoryProperties& memory_properties,
+		uint32_t type_filter,
+		VkMemoryPropertyFlags properties)
+	{
+		for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+			if ((type_filter & (1 << i)) &&
+				(memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+
+		log("Failed to find a suitable memory type", ERROR);
+		return 0;
+	}
+
+	const char* memory_category_name(MEMORY_CATEGORY category) {
+		switch (category) {
+		case MEMORY_GEOMETRY: return "geometry";
+		case MEMORY_TEXTURE: return "textures";
+		case MEMORY_RENDER_TARGET: return "render targets";
+		case MEMORY_STAGING: return "staging";
+		case MEMORY_DYNAMIC: return "dynamic";
+		default: return "unknown";
+		}
+	}
+
+	void Allocator::init(VkDevice device, const DeviceSnapshot& snapshot, bool memory_budget) {
+		this->device = device;
+		this->physical_device = snapshot.device;
+		this->memory_budget = memory_budget;
+		memory_properties = snapshot.memory_properties;
+		max_memory_objects = snapshot.properties.limits.maxMemoryAllocationCount;
+
+		// Blocks are an eighth of small heaps, like 256 MiB integrated carve outs
+		for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+			VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[i].heapIndex].size;
+			VkDeviceSize block_size = MAX_BLOCK_SIZE;
+			while (block_size > MIN_ALLOCATION && block_size > heap_size / 8) {
+				block_size >>= 1;
+			}
+			block_sizes[i] = block_size;
+		}
+
+		update_budget();
+	}
+
+	void Allocator::cleanup() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& block : blocks) {
+			if (block.memory != VK_NULL_HANDLE) {
+				free_memory(block.memory, block.memory_type, block.size, block.mapped);
+			}
+		}
+		blocks.clear();
+
+		if (memory_objects > 0) {
+			log(std::to_string(memory_objects) + " dedicated allocations were never freed", WARNING);
+		}
+	}
+
+	Allocation Allocator::allocate_buffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MEMORY_CATEGORY category) {
+		VkMemoryDedicatedRequirements dedicated_requirements{};
+		dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+		VkMemoryRequirements2 requirements{};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		requirements.pNext = &dedicated_requirements;
+
+		VkBufferMemoryRequirementsInfo2 info{};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+		info.buffer = buffer;
+		vkGetBufferMemoryRequirements2(device, &info, &requirements);
+
+		Allocation allocation = allocate(requirements.memoryRequirements, properties, category, true,
+			dedicated_requirements.prefersDedicatedAllocation, buffer, VK_NULL_HANDLE);
+
+		if (vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+			log("Failed to bind buffer memory", ERROR);
+		}
+
+		return allocation;
+	}
+
+	Allocation Allocator::allocate_image(VkImage image, VkMemoryPropertyFlags properties, MEMORY_CATEGORY category) {
+		VkMemoryDedicatedRequirements dedicated_requirements{};
+		dedicated_requirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+		VkMemoryRequirements2 requirements{};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		requirements.pNext = &dedicated_requirements;
+
+		VkImageMemoryRequirementsInfo2 info{};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+		info.image = image;
+		vkGetImageMemoryRequirements2(device, &info, &requirements);
+
+		// Only optimally tiled images are created through the allocator
+		Allocation allocation = allocate(requirements.memoryRequirements, properties, category, false,
+			dedicated_requirements.prefersDedicatedAllocation, VK_NULL_HANDLE, image);
+
+		if (vkBindImageMemory(device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+			log("Failed to bind image memory", ERROR);
+		}
+
+		return allocation;
+	}
+
+	Allocation Allocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+		MEMORY_CATEGORY category, bool linear, bool dedicated, VkBuffer dedicated_buffer, VkImage dedicated_image)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Allocation allocation;
+		allocation.memory_type = find_memory_type(memory_properties, requirements.memoryTypeBits, properties);
+		allocation.size = requirements.size;
+		allocation.category = category;
+		category_allocated[category] += allocation.size;
+
+		VkDeviceSize block_size = block_sizes[allocation.memory_type];
+		if (dedicated || requirements.size > block_size / 2) {
+			allocation.memory = allocate_memory(requirements.size, allocation.memory_type,
+				dedicated_buffer, dedicated_image, &allocation.mapped);
+			allocation.block = UINT32_MAX;
+			allocated += allocation.size;
+			dedicated_allocated += allocation.size;
+			return allocation;
+		}
+
+		uint32_t order = order_for(requirements);
+
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			const Block& block = blocks[i];
+			if (block.memory != VK_NULL_HANDLE && block.memory_type == allocation.memory_type &&
+				block.linear == linear && allocate_from_block(i, order, allocation))
+			{
+				return allocation;
+			}
+		}
+
+		uint32_t block_index = create_block(allocation.memory_type, linear);
+		if (!allocate_from_block(block_index, order, allocation)) {
+			log("Allocation doesn't fit in a new memory block", ERROR);
+		}
+
+		return allocation;
+	}
+
+	// Smallest power of two order that fits both size and alignment
+	uint32_t Allocator::order_for(const VkMemoryRequirements& requirements) const {
+		VkDeviceSize needed = std::max(requirements.size, requirements.alignment);
+		uint32_t order = 0;
+		while ((MIN_ALLOCATION << order) < needed) {
+			order++;
+		}
+		return order;
+	}
+
+	bool Allocator::allocate_from_block(uint32_t block_index, uint32_t order, Allocation& allocation) {
+		Block& block = blocks[block_index];
+		if (order > block.max_order) {
+			return false;
+		}
+
+		uint32_t found = order;
+		while (found <= block.max_order && block.free_lists[found].empty()) {
+			found++;
+		}
+		if (found > block.max_order) {
+			return false;
+		}
+
+		VkDeviceSize offset = *block.free_lists[found].begin();
+		block.free_lists[found].erase(block.free_lists[found].begin());
+
+		// Split down to the requested order, keeping the upper halves free
+		while (found > order) {
+			found--;
+			block.free_lists[found].insert(offset + (MIN_ALLOCATION << found));
+		}
+
+		block.used += MIN_ALLOCATION << order;
+		allocated += allocation.size;
+
+		allocation.memory = block.memory;
+		allocation.offset = offset;
+		allocation.block = block_index;
+		allocation.order = order;
+		allocation.mapped = block.mapped != nullptr ? static_cast<char*>(block.mapped) + offset : nullptr;
+
+		return true;
+	}
+
+	void Allocator::free(Allocation& allocation) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (allocation.memory == VK_NULL_HANDLE) {
+			return;
+		}
+
+		allocated -= allocation.size;
+		category_allocated[allocation.category] -= allocation.size;
+
+		if (allocation.block == UINT32_MAX) {
+			dedicated_allocated -= allocation.size;
+			free_memory(allocation.memory, allocation.memory_type, allocation.size, allocation.mapped);
+			allocation = Allocation{};
+			return;
+		}
+
+		Block& block = blocks[allocation.block];
+		VkDeviceSize offset = allocation.offset;
+		uint32_t order = allocation.order;
+		block.used -= MIN_ALLOCATION << order;
+
+		// Merge with the buddy for as long as it is free
+		while (order < block.max_order) {
+			VkDeviceSize buddy = offset ^ (MIN_ALLOCATION << order);
+			auto it = block.free_lists[order].find(buddy);
+			if (it == block.free_lists[order].end()) {
+				break;
+			}
+			block.free_lists[order].erase(it);
+			offset = std::min(offset, buddy);
+			order++;
+		}
+		block.free_lists[order].insert(offset);
+
+		if (block.used == 0) {
+			free_memory(block.memory, block.memory_type, block.size, block.mapped);
+			block = Block{};
+		}
+
+		allocation = Allocation{};
+	}
+
+	uint32_t Allocator::create_block(uint32_t memory_type, bool linear) {
+		Block block;
+		block.size = block_sizes[memory_type];
+		block.memory_type = memory_type;
+		block.linear = linear;
+		block.memory = allocate_memory(block.size, memory_type, VK_NULL_HANDLE, VK_NULL_HANDLE, &block.mapped);
+
+		while ((MIN_ALLOCATION << block.max_order) < block.size) {
+			block.max_order++;
+		}
+		block.free_lists.resize(block.max_order + 1);
+		block.free_lists[block.max_order].insert(0);
+
+		// Reuse the slot of a released block
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			if (blocks[i].memory == VK_NULL_HANDLE) {
+				blocks[i] = std::move(block);
+				return i;
+			}
+		}
+
+		blocks.push_back(std::move(block));
+		return static_cast<uint32_t>(blocks.size() - 1);
+	}
+
+	VkDeviceMemory Allocator::allocate_memory(VkDeviceSize size, uint32_t memory_type,
+		VkBuffer dedicated_buffer, VkImage dedicated_image, void** mapped)
+	{
+		if (memory_objects >= max_memory_objects) {
+			log("maxMemoryAllocationCount reached (" + std::to_string(max_memory_objects) + ")", ERROR);
+		}
+
+		VkMemoryDedicatedAllocateInfo dedicated_info{};
+		dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+		dedicated_info.buffer = dedicated_buffer;
+		dedicated_info.image = dedicated_image;
+
+		VkMemoryAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		alloc_info.allocationSize = size;
+		alloc_info.memoryTypeIndex = memory_type;
+		if (dedicated_buffer != VK_NULL_HANDLE || dedicated_image != VK_NULL_HANDLE) {
+			alloc_info.pNext = &dedicated_info;
+		}
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &alloc_info, host_callbacks(HOST_SCOPE_DEVICE), &memory) != VK_SUCCESS) {
+			log("Failed to allocate device memory", ERROR);
+		}
+		memory_objects++;
+		heap_allocated[memory_properties.memoryTypes[memory_type].heapIndex] += size;
+
+		*mapped = nullptr;
+		if (memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+				log("Failed to map device memory", ERROR);
+			}
+		}
+
+		return memory;
+	}
+
+	void Allocator::free_memory(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size, void* mapped) {
+		if (mapped != nullptr) {
+			vkUnmapMemory(device, memory);
+		}
+		vkFreeMemory(device, memory, host_callbacks(HOST_SCOPE_DEVICE));
+		memory_objects--;
+		heap_allocated[memory_properties.memoryTypes[memory_type].heapIndex] -= size;
+	}
+
+	bool Allocator::relocate_buffer(VkBuffer buffer, const Allocation& current, Allocation& relocated) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (current.block == UINT32_MAX) {
+			return false;
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetBufferMemoryRequirements(device, buffer, &requirements);
+		if (!(requirements.memoryTypeBits & (1 << current.memory_type))) {
+			return false;
+		}
+
+		relocated = Allocation{};
+		relocated.memory_type = current.memory_type;
+		relocated.size = requirements.size;
+		relocated.category = current.category;
+
+		uint32_t order = order_for(requirements);
+		const Block& source = blocks[current.block];
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			const Block& block = blocks[i];
+			if (i != current.block && block.memory != VK_NULL_HANDLE &&
+				block.memory_type == source.memory_type && block.linear == source.linear &&
+				allocate_from_block(i, order, relocated))
+			{
+				if (vkBindBufferMemory(device, buffer, relocated.memory, relocated.offset) != VK_SUCCESS) {
+					log("Failed to bind buffer memory", ERROR);
+				}
+				category_allocated[relocated.category] += relocated.size;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	uint32_t Allocator::sparsest_block(float max_usage) const {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint32_t sparsest = UINT32_MAX;
+		float sparsest_usage = max_usage;
+
+		for (uint32_t i = 0; i < blocks.size(); i++) {
+			const Block& block = blocks[i];
+			if (block.memory == VK_NULL_HANDLE) {
+				continue;
+			}
+
+			bool has_sibling = std::any_of(blocks.begin(), blocks.end(), [&](const Block& other) {
+				return &other != &block && other.memory != VK_NULL_HANDLE &&
+					other.memory_type == block.memory_type && other.linear == block.linear;
+			});
+
+			float usage = static_cast<float>(block.used) / static_cast<float>(block.size);
+			if (has_sibling && usage < sparsest_usage) {
+				sparsest = i;
+				sparsest_usage = usage;
+			}
+		}
+
+		return sparsest;
+	}
+
+	VkDeviceSize Allocator::largest_free(const Block& block) const {
+		for (uint32_t order = block.max_order + 1; order-- > 0;) {
+			if (!block.free_lists[order].empty()) {
+				return MIN_ALLOCATION << order;
+			}
+		}
+		return 0;
+	}
+
+	MemoryStats Allocator::stats() const {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryStats stats;
+
+		for (const auto& block : blocks) {
+			if (block.memory == VK_NULL_HANDLE) {
+				continue;
+			}
+			stats.block_count++;
+			stats.block_bytes += block.size;
+			stats.used_bytes += block.used;
+			stats.largest_free = std::max(stats.largest_free, largest_free(block));
+		}
+
+		stats.dedicated_count = memory_objects - stats.block_count;
+		stats.dedicated_bytes = dedicated_allocated;
+
+		VkDeviceSize free_bytes = stats.block_bytes - stats.used_bytes;
+		if (free_bytes > 0) {
+			stats.fragmentation = 1.0f - static_cast<float>(stats.largest_free) / static_cast<float>(free_bytes);
+		}
+
+		for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+			stats.category_bytes[i] = category_allocated[i];
+		}
+
+		stats.heap_count = memory_properties.memoryHeapCount;
+		for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+			HeapBudget& heap = stats.heaps[i];
+			heap.size = memory_properties.memoryHeaps[i].size;
+			heap.budget = heap_budget[i];
+			heap.usage = heap_usage[i];
+			heap.allocated = heap_allocated[i];
+			heap.device_local = (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		}
+
+		return stats;
+	}
+
+	void Allocator::update_budget() {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{};
+		budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		if (memory_budget) {
+			properties.pNext = &budget_properties;
+			vkGetPhysicalDeviceMemoryProperties2(physical_device, &properties);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+			if (memory_budget) {
+				heap_budget[i] = budget_properties.heapBudget[i];
+				heap_usage[i] = budget_properties.heapUsage[i];
+			}
+			else {
+				heap_budget[i] = static_cast<VkDeviceSize>(memory_properties.memoryHeaps[i].size * ESTIMATED_BUDGET);
+				heap_usage[i] = heap_allocated[i];
+			}
+		}
+	}
+
+	VkDeviceSize Allocator::allocated_bytes() const {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		return allocated;
+	}
+
+	uint32_t Allocator::memory_object_count() const {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		return memory_objects;
+	}
+
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <set>
+#include <mutex>
+
+#include "debug.h"
+#include "host_memory.h"
+#include "snapshot.h"
+
+namespace LLAP {
+
+	typedef enum MEMORY_CATEGORY {
+		MEMORY_GEOMETRY,
+		MEMORY_TEXTURE,
+		MEMORY_RENDER_TARGET,
+		MEMORY_STAGING,
+		MEMORY_DYNAMIC, // Written by the CPU every frame
+		MEMORY_CATEGORY_COUNT,
+	} MEMORY_CATEGORY;
+
+	const char* memory_category_name(MEMORY_CATEGORY category);
+
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr; // Set when the memory type is host visible
+
+		// Bookkeeping for the allocator
+		MEMORY_CATEGORY category = MEMORY_GEOMETRY;
+		uint32_t memory_type = 0;
+		uint32_t block = UINT32_MAX; // UINT32_MAX for dedicated allocations
+		uint32_t order = 0;
+	};
+
+	struct HeapBudget {
+		VkDeviceSize size = 0;
+		VkDeviceSize budget = 0; // What the process may use before the driver starts paging or failing
+		VkDeviceSize usage = 0; // By the whole process, not only this allocator
+		VkDeviceSize allocated = 0; // Memory objects of this allocator
+		bool device_local = false;
+	};
+
+	struct MemoryStats {
+		uint32_t block_count = 0;
+		uint32_t dedicated_count = 0;
+		VkDeviceSize block_bytes = 0; // Total size of all blocks
+		VkDeviceSize used_bytes = 0; // Inside blocks, rounded up to buddy sizes
+		VkDeviceSize dedicated_bytes = 0;
+		VkDeviceSize largest_free = 0; // Largest single allocation the blocks could still serve
+		float fragmentation = 0.0f; // 1 - largest_free / free bytes, 0 when all free space is one range
+		VkDeviceSize category_bytes[MEMORY_CATEGORY_COUNT] = {};
+		HeapBudget heaps[VK_MAX_MEMORY_HEAPS];
+		uint32_t heap_count = 0;
+	};
+
+	uint32_t find_memory_type(
+		const VkPhysicalDeviceMemoryProperties& memory_properties,
+		uint32_t type_filter,
+		VkMemoryPropertyFlags properties);
+
+	// Carves buffers and images out of large VkDeviceMemory blocks with a buddy
+	// allocator per memory type. Buddy offsets are aligned to their own size, so
+	// any alignment up to the allocation size holds. Linear and optimally tiled
+	// resources never share a block, which keeps bufferImageGranularity out of
+	// the picture. Large resources, and those the driver asks for, get a
+	// dedicated allocation. Host visible blocks stay mapped. All methods may be
+	// called from any thread.
+	class Allocator {
+	public:
+		// Without memory_budget the budget is estimated from the heap sizes and
+		// the usage only counts this allocator
+		void init(VkDevice device, const DeviceSnapshot& snapshot, bool memory_budget);
+		void cleanup();
+
+		// Allocate memory for the resource and bind it
+		Allocation allocate_buffer(VkBuffer buffer, VkMemoryPropertyFlags properties, MEMORY_CATEGORY category);
+		Allocation allocate_image(VkImage image, VkMemoryPropertyFlags properties, MEMORY_CATEGORY category);
+		void free(Allocation& allocation);
+
+		// Allocates for buffer from another existing block of current's memory type and
+		// binds it. Never creates blocks, so it fails rather than growing memory use.
+		bool relocate_buffer(VkBuffer buffer, const Allocation& current, Allocation& relocated);
+
+		// The block that is the best candidate to empty, UINT32_MAX if none is worth it.
+		// Only blocks with another block of the same kind to move into are considered.
+		uint32_t sparsest_block(float max_usage) const;
+
+		// Queries the heap budgets again, cheap enough to do every frame
+		void update_budget();
+
+		VkDeviceSize allocated_bytes() const;
+		uint32_t memory_object_count() const;
+		MemoryStats stats() const;
+
+	private:
+		static const VkDeviceSize MIN_ALLOCATION = 256;
+		static const VkDeviceSize MAX_BLOCK_SIZE = 64ull * 1024 * 1024;
+		static constexpr float ESTIMATED_BUDGET = 0.8f; // Of each heap, without VK_EXT_memory_budget
+
+		struct Block {
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			VkDeviceSize used = 0;
+			uint32_t memory_type = 0;
+			uint32_t max_order = 0;
+			bool linear = true;
+			void* mapped = nullptr;
+			std::vector<std::set<VkDeviceSize>> free_lists; // Free offsets per order
+		};
+
+		mutable std::mutex mutex;
+		VkDevice device = VK_NULL_HANDLE;
+		VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+		bool memory_budget = false;
+		VkPhysicalDeviceMemoryProperties memory_properties;
+		VkDeviceSize block_sizes[VK_MAX_MEMORY_TYPES];
+		uint32_t max_memory_objects = 0;
+		uint32_t memory_objects = 0;
+		VkDeviceSize allocated = 0;
+		VkDeviceSize dedicated_allocated = 0;
+		VkDeviceSize category_allocated[MEMORY_CATEGORY_COUNT] = {};
+		VkDeviceSize heap_allocated[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize heap_budget[VK_MAX_MEMORY_HEAPS] = {};
+		VkDeviceSize heap_usage[VK_MAX_MEMORY_HEAPS] = {};
+		std::vector<Block> blocks; // Released blocks leave an empty slot
+
+		Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties,
+			MEMORY_CATEGORY category, bool linear, bool dedicated, VkBuffer dedicated_buffer, VkImage dedicated_image);
+		bool allocate_from_block(uint32_t block_index, uint32_t order, Allocation& allocation);
+		uint32_t order_for(const VkMemoryRequirements& requirements) const;
+		VkDeviceSize largest_free(const Block& block) const;
+		uint32_t create_block(uint32_t memory_type, bool linear);
+		VkDeviceMemory allocate_memory(VkDeviceSize size, uint32_t memory_type,
+			VkBuffer dedicated_buffer, VkImage dedicated_image, void** mapped);
+		void free_memory(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size, void* mapped);
+	};
+
+}
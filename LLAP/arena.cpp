@@ -0,0 +1,139 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI // Keeps ERROR from being defined
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace LLAP {
+
+	static const size_t CACHE_LINE = 64;
+
+	// Returns nullptr when large pages aren't available
+	static void* allocate_large_pages(size_t& size) {
+#ifdef _WIN32
+		size_t page = GetLargePageMinimum();
+		if (page == 0) {
+			return nullptr;
+		}
+		size = (size + page - 1) / page * page;
+		return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+#else
+		const size_t page = 2 * 1024 * 1024;
+		size = (size + page - 1) / page * page;
+		void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		return memory != MAP_FAILED ? memory : nullptr;
+#endif
+	}
+
+	static void free_large_pages(void* memory, size_t size) {
+#ifdef _WIN32
+		VirtualFree(memory, 0, MEM_RELEASE);
+#else
+		munmap(memory, size);
+#endif
+	}
+
+	void FrameArena::init(size_t frame_size, uint32_t frame_count, bool huge_pages) {
+		partition_size = (frame_size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+		memory_size = partition_size * frame_count;
+
+		large_pages = false;
+		if (huge_pages) {
+			size_t size = memory_size;
+			memory = static_cast<char*>(allocate_large_pages(size));
+			if (memory != nullptr) {
+				large_pages = true;
+				memory_size = size;
+			}
+			else {
+				log("Large pages unavailable, the frame arena uses normal pages", WARNING);
+			}
+		}
+		if (memory == nullptr) {
+			memory = static_cast<char*>(::operator new(memory_size, std::align_val_t(CACHE_LINE)));
+		}
+
+		partitions.resize(frame_count);
+		for (uint32_t i = 0; i < frame_count; i++) {
+			partitions[i].begin = memory + partition_size * i;
+			partitions[i].overflow = std::make_unique<std::pmr::monotonic_buffer_resource>();
+		}
+		current = &partitions[0];
+	}
+
+	void FrameArena::cleanup() {
+		partitions.clear();
+		current = nullptr;
+
+		if (memory == nullptr) {
+			return;
+		}
+		if (large_pages) {
+			free_large_pages(memory, memory_size);
+		}
+		else {
+			::operator delete(memory, std::align_val_t(CACHE_LINE));
+		}
+		memory = nullptr;
+	}
+
+	void FrameArena::begin_frame(uint32_t frame) {
+		current = &partitions[frame];
+
+		if (current->overflow_bytes > 0 && !warned) {
+			log("Frame arena overflowed by " + std::to_string(current->overflow_bytes) +
+				" bytes, raise its frame size to at least " + std::to_string(peak_bytes), WARNING);
+			warned = true;
+		}
+
+		current->head = 0;
+		current->overflow_bytes = 0;
+		current->overflow->release();
+	}
+
+	void* FrameArena::do_allocate(size_t bytes, size_t alignment) {
+		// Partitions are only cache line aligned, so align the address rather than the offset
+		uintptr_t base = reinterpret_cast<uintptr_t>(current->begin);
+		size_t offset = ((base + current->head + alignment - 1) & ~(alignment - 1)) - base;
+
+		if (offset + bytes > partition_size) {
+			current->overflow_bytes += bytes;
+			peak_bytes = std::max(peak_bytes, current->head + current->overflow_bytes);
+			return current->overflow->allocate(bytes, alignment);
+		}
+
+		current->head = offset + bytes;
+		peak_bytes = std::max(peak_bytes, current->head + current->overflow_bytes);
+		return current->begin + offset;
+	}
+
+	void FrameArena::do_deallocate(void*, size_t, size_t) {
+		// Released with the partition
+	}
+
+	bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+		return this == &other;
+	}
+
+	size_t FrameArena::used() const {
+		return current != nullptr ? current->head : 0;
+	}
+
+	size_t FrameArena::peak() const {
+		return peak_bytes;
+	}
+
+	size_t FrameArena::frame_size() const {
+		return partition_size;
+	}
+
+}
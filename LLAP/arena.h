@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory_resource>
+#include <memory>
+#include <vector>
+
+#include "debug.h"
+
+namespace LLAP {
+
+	// Bump allocator for data that only lives for a frame, split into a partition
+	// per frame in flight like FrameRing. Use it through std::pmr containers.
+	// Deallocation does nothing, a partition is reset as a whole when its frame
+	// comes round again. Allocations that don't fit go to the heap and are
+	// released at the same time.
+	class FrameArena : public std::pmr::memory_resource {
+	public:
+		// Large pages need SeLockMemoryPrivilege on Windows and reserved huge
+		// pages on Linux, normal pages are used when they can't be had
+		void init(size_t frame_size, uint32_t frame_count, bool huge_pages = false);
+		void cleanup();
+
+		void begin_frame(uint32_t frame);
+
+		size_t used() const; // By the current frame, without overflow
+		size_t peak() const; // Most any frame used, with overflow
+		size_t frame_size() const;
+
+	private:
+		struct Partition {
+			char* begin = nullptr;
+			size_t head = 0;
+			size_t overflow_bytes = 0;
+			std::unique_ptr<std::pmr::monotonic_buffer_resource> overflow;
+		};
+
+		char* memory = nullptr;
+		size_t memory_size = 0;
+		bool large_pages = false;
+		size_t partition_size = 0;
+		size_t peak_bytes = 0;
+		bool warned = false;
+
+		std::vector<Partition> partitions;
+		Partition* current = nullptr;
+
+		void* do_allocate(size_t bytes, size_t alignment) override;
+		void do_deallocate(void* pointer, size_t bytes, size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+	};
+
+}
@@ -0,0 +1,212 @@
+#include "atlas.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace LLAP {
+
+	static uint32_t round_up(uint32_t value, uint32_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	struct Placement {
+		uint32_t layer = 0;
+		uint32_t x = 0;
+		uint32_t y = 0;
+		uint32_t width = 0; // Including padding
+		uint32_t height = 0;
+	};
+
+	struct Shelf {
+		uint32_t layer;
+		uint32_t y;
+		uint32_t height;
+		uint32_t x; // Filled up to here
+	};
+
+	TextureData pack_atlas(const std::vector<TextureData>& textures, const AtlasSettings& settings,
+		std::vector<AtlasRect>& rects)
+	{
+		if (textures.empty()) {
+			log("Nothing to pack into an atlas", ERROR);
+		}
+
+		VkFormat format = textures[0].format;
+		FormatBlock block;
+		if (!format_block(format, block)) {
+			log("Can't pack format " + std::to_string(format) + " into an atlas", ERROR);
+		}
+
+		uint32_t size = settings.layer_size;
+		uint32_t level_count = std::min(std::max(settings.max_levels, 1u), mip_count({ size, size }));
+		for (size_t i = 0; i < textures.size(); i++) {
+			if (textures[i].format != format || textures[i].layer_count != 1) {
+				log("Atlas texture " + std::to_string(i) + " isn't a single layer of the first one's format", ERROR);
+			}
+			level_count = std::min(level_count, std::max(textures[i].level_count(), 1u));
+		}
+
+		// Every level of every rect starts and ends on a block
+		uint32_t align_x = block.width << (level_count - 1);
+		uint32_t align_y = block.height << (level_count - 1);
+		uint32_t padding_x = round_up(settings.padding, align_x);
+		uint32_t padding_y = round_up(settings.padding, align_y);
+		if (size % align_x != 0 || size % align_y != 0) {
+			log("Atlas layers of " + std::to_string(size) + " texels can't hold " + std::to_string(level_count) + " levels", ERROR);
+		}
+
+		std::vector<Placement> placements(textures.size());
+		std::vector<uint32_t> order(textures.size());
+		for (uint32_t i = 0; i < textures.size(); i++) {
+			placements[i].width = round_up(textures[i].extent.width, align_x) + padding_x * 2;
+			placements[i].height = round_up(textures[i].extent.height, align_y) + padding_y * 2;
+			if (placements[i].width > size || placements[i].height > size) {
+				log("Atlas texture " + std::to_string(i) + " doesn't fit a layer", ERROR);
+			}
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return placements[a].height > placements[b].height;
+		});
+
+		std::vector<Shelf> shelves;
+		uint32_t layer_count = 0;
+		uint32_t layer_top = 0; // Where the next shelf of the last layer starts
+		for (uint32_t index : order) {
+			Placement& placement = placements[index];
+
+			// First fit, earlier shelves are at least as tall
+			Shelf* shelf = nullptr;
+			for (auto& candidate : shelves) {
+				if (candidate.height >= placement.height && candidate.x + placement.width <= size) {
+					shelf = &candidate;
+					break;
+				}
+			}
+
+			if (shelf == nullptr) {
+				if (layer_count == 0 || layer_top + placement.height > size) {
+					layer_count++;
+					layer_top = 0;
+				}
+				shelves.push_back({ layer_count - 1, layer_top, placement.height, 0 });
+				layer_top += placement.height;
+				shelf = &shelves.back();
+			}
+
+			placement.layer = shelf->layer;
+			placement.x = shelf->x;
+			placement.y = shelf->y;
+			shelf->x += placement.width;
+		}
+
+		TextureData data;
+		data.format = format;
+		data.extent = { size, size };
+		data.layer_count = layer_count;
+
+		VkDeviceSize offset = 0;
+		for (uint32_t level = 0; level < level_count; level++) {
+			data.level_offsets.push_back(offset);
+			data.level_sizes.push_back(level_size(block, mip_extent(data.extent, level)) * layer_count);
+			offset += data.level_sizes.back();
+		}
+		data.bytes.resize(static_cast<size_t>(offset));
+
+		rects.resize(textures.size());
+		for (uint32_t i = 0; i < textures.size(); i++) {
+			const Placement& placement = placements[i];
+			const TextureData& texture = textures[i];
+
+			AtlasRect& rect = rects[i];
+			rect.layer = placement.layer;
+			rect.u0 = static_cast<float>(placement.x + padding_x) / size;
+			rect.v0 = static_cast<float>(placement.y + padding_y) / size;
+			rect.u1 = static_cast<float>(placement.x + padding_x + texture.extent.width) / size;
+			rect.v1 = static_cast<float>(placement.y + padding_y + texture.extent.height) / size;
+
+			// The padded rect repeats the texture's edge, in whole blocks so compressed data is copied as is
+			for (uint32_t level = 0; level < level_count; level++) {
+				VkExtent2D layer_extent = mip_extent(data.extent, level);
+				VkExtent2D extent = mip_extent(texture.extent, level);
+				uint32_t layer_blocks_x = (layer_extent.width + block.width - 1) / block.width;
+				uint32_t blocks_x = (extent.width + block.width - 1) / block.width;
+				uint32_t blocks_y = (extent.height + block.height - 1) / block.height;
+
+				uint32_t rect_x = (placement.x >> level) / block.width;
+				uint32_t rect_y = (placement.y >> level) / block.height;
+				uint32_t rect_width = (placement.width >> level) / block.width;
+				uint32_t rect_height = (placement.height >> level) / block.height;
+				int32_t border_x = static_cast<int32_t>((padding_x >> level) / block.width);
+				int32_t border_y = static_cast<int32_t>((padding_y >> level) / block.height);
+
+				char* layer = data.bytes.data() + data.level_offsets[level] +
+					level_size(block, layer_extent) * placement.layer;
+				const char* source = texture.level_data(level);
+
+				for (uint32_t y = 0; y < rect_height; y++) {
+					int32_t source_y = std::min(std::max(static_cast<int32_t>(y) - border_y, 0), static_cast<int32_t>(blocks_y) - 1);
+					char* dst = layer + (static_cast<size_t>(rect_y + y) * layer_blocks_x + rect_x) * block.bytes;
+					for (uint32_t x = 0; x < rect_width; x++) {
+						int32_t source_x = std::min(std::max(static_cast<int32_t>(x) - border_x, 0), static_cast<int32_t>(blocks_x) - 1);
+						std::memcpy(dst, source + (static_cast<size_t>(source_y) * blocks_x + source_x) * block.bytes, block.bytes);
+						dst += block.bytes;
+					}
+				}
+			}
+		}
+
+		return data;
+	}
+
+	void write_atlas_table(const std::string& path, const std::vector<std::string>& names, const std::vector<AtlasRect>& rects) {
+		std::ofstream file(path, std::ios::trunc);
+		if (!file.is_open()) {
+			log("Failed to open file", ERROR);
+		}
+
+		// Enough digits for floats to read back exactly
+		file << std::setprecision(9);
+		for (size_t i = 0; i < rects.size(); i++) {
+			const AtlasRect& rect = rects[i];
+			file << rect.layer << ' ' << rect.u0 << ' ' << rect.v0 << ' ' << rect.u1 << ' ' << rect.v1 << ' ' << names[i] << '\n';
+		}
+
+		if (!file) {
+			log("Failed to write " + path, ERROR);
+		}
+	}
+
+	std::unordered_map<std::string, AtlasRect> read_atlas_table(const std::string& path) {
+		std::ifstream file(path);
+		if (!file.is_open()) {
+			log("Failed to open file", ERROR);
+		}
+
+		std::unordered_map<std::string, AtlasRect> rects;
+		std::string line;
+		while (std::getline(file, line)) {
+			if (line.empty()) {
+				continue;
+			}
+
+			// The name is the rest of the line, it may contain spaces
+			std::istringstream fields(line);
+			AtlasRect rect;
+			std::string name;
+			fields >> rect.layer >> rect.u0 >> rect.v0 >> rect.u1 >> rect.v1;
+			fields.get();
+			std::getline(fields, name);
+			if (fields.fail() || name.empty()) {
+				log("Corrupt atlas table line: " + line, ERROR);
+			}
+			rects[name] = rect;
+		}
+
+		return rects;
+	}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "debug.h"
+#include "image.h"
+#include "texture.h"
+
+namespace LLAP {
+
+	struct AtlasSettings {
+		uint32_t layer_size = 2048;
+		// Texels of edge repeated around every texture at level 0, rounded up so
+		// every level keeps at least a texel of it
+		uint32_t padding = 4;
+		uint32_t max_levels = 5;
+	};
+
+	// Where a packed texture ended up, uv = rect.xy + uv * (rect.zw - rect.xy)
+	struct AtlasRect {
+		uint32_t layer = 0;
+		float u0 = 0.0f;
+		float v0 = 0.0f;
+		float u1 = 1.0f;
+		float v1 = 1.0f;
+	};
+
+	// Packs textures of one format into layers of a 2D array texture, a plain
+	// atlas when they fit one layer. Shelves are filled tallest first. Levels are
+	// copied from each texture's own mips rather than filtered across
+	// neighbours, so the atlas has as many levels as the padding protects and
+	// every texture provides. Runs offline, nothing touches the device.
+	TextureData pack_atlas(const std::vector<TextureData>& textures, const AtlasSettings& settings,
+		std::vector<AtlasRect>& rects);
+
+	// The remap table is text, one "layer u0 v0 u1 v1 name" line per texture
+	void write_atlas_table(const std::string& path, const std::vector<std::string>& names, const std::vector<AtlasRect>& rects);
+	std::unordered_map<std::string, AtlasRect> read_atlas_table(const std::string& path);
+
+}
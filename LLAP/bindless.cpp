@@ -0,0 +1,217 @@
+#include "bindless.h"
+
+#include <algorithm>
+#include <string>
+
+namespace LLAP {
+
+	void BindlessTable::init(VkDevice device, const DeviceSnapshot& snapshot,
+		uint32_t max_textures, uint32_t max_storage_buffers, uint32_t max_samplers, uint32_t other_resources)
+	{
+		this->device = device;
+
+		const VkPhysicalDeviceDescriptorIndexingProperties& limits = snapshot.descriptor_indexing_properties;
+		slots[BINDLESS_SAMPLERS].capacity = std::min({ max_samplers,
+			limits.maxDescriptorSetUpdateAfterBindSamplers, limits.maxPerStageDescriptorUpdateAfterBindSamplers });
+		slots[BINDLESS_STORAGE_BUFFERS].capacity = std::min({ max_storage_buffers,
+			limits.maxDescriptorSetUpdateAfterBindStorageBuffers, limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+		slots[BINDLESS_TEXTURES].capacity = std::min({ max_textures,
+			limits.maxDescriptorSetUpdateAfterBindSampledImages, limits.maxPerStageDescriptorUpdateAfterBindSampledImages });
+
+		// The per stage resource limit covers all three bindings and the other sets, shrink them alike
+		uint64_t total = 0;
+		for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+			total += slots[i].capacity;
+		}
+		uint32_t limit = limits.maxPerStageUpdateAfterBindResources;
+		uint64_t available = limit > other_resources ? limit - other_resources : 0;
+		if (total > available) {
+			for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+				slots[i].capacity = static_cast<uint32_t>(slots[i].capacity * available / total);
+			}
+			log("Bindless table exceeds the " + std::to_string(limit) + " resources per stage, reduced to " +
+				std::to_string(slots[BINDLESS_TEXTURES].capacity) + " textures, " +
+				std::to_string(slots[BINDLESS_STORAGE_BUFFERS].capacity) + " storage buffers and " +
+				std::to_string(slots[BINDLESS_SAMPLERS].capacity) + " samplers", WARNING);
+		}
+
+		const VkDescriptorType types[BINDLESS_BINDING_COUNT] = {
+			VK_DESCRIPTOR_TYPE_SAMPLER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+		};
+
+		VkDescriptorSetLayoutBinding bindings[BINDLESS_BINDING_COUNT];
+		VkDescriptorBindingFlags binding_flags[BINDLESS_BINDING_COUNT];
+		VkDescriptorPoolSize pool_sizes[BINDLESS_BINDING_COUNT];
+		for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+			bindings[i] = {};
+			bindings[i].binding = i;
+			bindings[i].descriptorType = types[i];
+			bindings[i].descriptorCount = std::max(slots[i].capacity, 1u);
+			bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+
+			// Unwritten slots are fine as long as shaders don't index them
+			binding_flags[i] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+				VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+				VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+			pool_sizes[i].type = types[i];
+			pool_sizes[i].descriptorCount = bindings[i].descriptorCount;
+		}
+		binding_flags[BINDLESS_TEXTURES] |= VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{};
+		flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		flags_info.bindingCount = BINDLESS_BINDING_COUNT;
+		flags_info.pBindingFlags = binding_flags;
+
+		VkDescriptorSetLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.pNext = &flags_info;
+		layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		layout_info.bindingCount = BINDLESS_BINDING_COUNT;
+		layout_info.pBindings = bindings;
+
+		if (vkCreateDescriptorSetLayout(device, &layout_info, host_callbacks(HOST_SCOPE_PIPELINE), &layout) != VK_SUCCESS) {
+			log("Failed to create bindless descriptor set layout", ERROR);
+		}
+
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		pool_info.maxSets = 1;
+		pool_info.poolSizeCount = BINDLESS_BINDING_COUNT;
+		pool_info.pPoolSizes = pool_sizes;
+
+		if (vkCreateDescriptorPool(device, &pool_info, host_callbacks(HOST_SCOPE_DEVICE), &pool) != VK_SUCCESS) {
+			log("Failed to create bindless descriptor pool", ERROR);
+		}
+
+		uint32_t texture_count = bindings[BINDLESS_TEXTURES].descriptorCount;
+
+		VkDescriptorSetVariableDescriptorCountAllocateInfo count_info{};
+		count_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+		count_info.descriptorSetCount = 1;
+		count_info.pDescriptorCounts = &texture_count;
+
+		VkDescriptorSetAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.pNext = &count_info;
+		alloc_info.descriptorPool = pool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &layout;
+
+		if (vkAllocateDescriptorSets(device, &alloc_info, &set) != VK_SUCCESS) {
+			log("Failed to allocate bindless descriptor set", ERROR);
+		}
+
+		log("Bindless table: " + std::to_string(slots[BINDLESS_TEXTURES].capacity) + " textures, " +
+			std::to_string(slots[BINDLESS_STORAGE_BUFFERS].capacity) + " storage buffers, " +
+			std::to_string(slots[BINDLESS_SAMPLERS].capacity) + " samplers");
+	}
+
+	void BindlessTable::cleanup() {
+		vkDestroyDescriptorPool(device, pool, host_callbacks(HOST_SCOPE_DEVICE));
+		vkDestroyDescriptorSetLayout(device, layout, host_callbacks(HOST_SCOPE_PIPELINE));
+		pool = VK_NULL_HANDLE;
+		layout = VK_NULL_HANDLE;
+		set = VK_NULL_HANDLE;
+	}
+
+	uint32_t BindlessTable::take_slot(BINDLESS_BINDING binding) {
+		Slots& table = slots[binding];
+
+		if (!table.free.empty()) {
+			uint32_t index = table.free.back();
+			table.free.pop_back();
+			return index;
+		}
+
+		if (table.next >= table.capacity) {
+			log("Bindless table is full", ERROR);
+		}
+		return table.next++;
+	}
+
+	void BindlessTable::write(BINDLESS_BINDING binding, uint32_t index, VkDescriptorType type,
+		const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info)
+	{
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = set;
+		write.dstBinding = binding;
+		write.dstArrayElement = index;
+		write.descriptorCount = 1;
+		write.descriptorType = type;
+		write.pImageInfo = image_info;
+		write.pBufferInfo = buffer_info;
+
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+
+	uint32_t BindlessTable::add_texture(VkImageView view, VkImageLayout layout) {
+		uint32_t index = take_slot(BINDLESS_TEXTURES);
+		update_texture(index, view, layout);
+		return index;
+	}
+
+	uint32_t BindlessTable::add_storage_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+		uint32_t index = take_slot(BINDLESS_STORAGE_BUFFERS);
+		update_storage_buffer(index, buffer, offset, range);
+		return index;
+	}
+
+	uint32_t BindlessTable::add_sampler(VkSampler sampler) {
+		uint32_t index = take_slot(BINDLESS_SAMPLERS);
+
+		VkDescriptorImageInfo image_info{};
+		image_info.sampler = sampler;
+		write(BINDLESS_SAMPLERS, index, VK_DESCRIPTOR_TYPE_SAMPLER, &image_info, nullptr);
+
+		return index;
+	}
+
+	void BindlessTable::update_texture(uint32_t index, VkImageView view, VkImageLayout layout) {
+		VkDescriptorImageInfo image_info{};
+		image_info.imageView = view;
+		image_info.imageLayout = layout;
+		write(BINDLESS_TEXTURES, index, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &image_info, nullptr);
+	}
+
+	void BindlessTable::update_storage_buffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+		VkDescriptorBufferInfo buffer_info{};
+		buffer_info.buffer = buffer;
+		buffer_info.offset = offset;
+		buffer_info.range = range;
+		write(BINDLESS_STORAGE_BUFFERS, index, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, nullptr, &buffer_info);
+	}
+
+	void BindlessTable::remove(BINDLESS_BINDING binding, uint32_t index, uint64_t retire_value) {
+		retired.push_back({ binding, index, retire_value });
+	}
+
+	void BindlessTable::release_retired(uint64_t completed_value) {
+		for (const auto& entry : retired) {
+			if (entry.value <= completed_value) {
+				slots[entry.binding].free.push_back(entry.index);
+			}
+		}
+
+		retired.erase(std::remove_if(retired.begin(), retired.end(),
+			[&](const Retired& entry) { return entry.value <= completed_value; }), retired.end());
+	}
+
+	VkDescriptorSetLayout BindlessTable::get_layout() const {
+		return layout;
+	}
+
+	VkDescriptorSet BindlessTable::get_set() const {
+		return set;
+	}
+
+	uint32_t BindlessTable::capacity(BINDLESS_BINDING binding) const {
+		return slots[binding].capacity;
+	}
+
+}
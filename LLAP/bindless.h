@@ -0,0 +1,84 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "host_memory.h"
+#include "snapshot.h"
+
+namespace LLAP {
+
+	// Bindings of the bindless set, shaders declare them as unsized arrays, e.g.
+	// layout(set = 1, binding = 2) uniform texture2D textures[];
+	// Array textures share the binding through a second declaration of type
+	// texture2DArray.
+	typedef enum BINDLESS_BINDING {
+		BINDLESS_SAMPLERS = 0,
+		BINDLESS_STORAGE_BUFFERS = 1,
+		BINDLESS_TEXTURES = 2, // Last, so it can have a variable count
+		BINDLESS_BINDING_COUNT,
+	} BINDLESS_BINDING;
+
+	// One descriptor set holding every texture, sampler and storage buffer, bound
+	// once per command buffer. Resources are referenced from shaders by their
+	// 32-bit index, so changing materials needs no descriptor rebinding. Slots are
+	// written with update-after-bind while frames are in flight, and removed
+	// indices are only handed out again once no submitted frame can read them.
+	class BindlessTable {
+	public:
+		static const uint32_t INVALID_INDEX = UINT32_MAX;
+
+		// Counts are clamped to the device's update-after-bind limits. Every stage
+		// sees the whole table, so together with other_resources, the descriptors
+		// of the pipeline layout's other sets, they also fit the per stage limit.
+		void init(VkDevice device, const DeviceSnapshot& snapshot,
+			uint32_t max_textures, uint32_t max_storage_buffers, uint32_t max_samplers, uint32_t other_resources = 0);
+		void cleanup();
+
+		uint32_t add_texture(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		uint32_t add_storage_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+		uint32_t add_sampler(VkSampler sampler);
+
+		// Points an existing slot at another resource. Frames in flight may not read
+		// the slot, so replace resources they use with add_* and remove() instead.
+		void update_texture(uint32_t index, VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		void update_storage_buffer(uint32_t index, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+		// The index is reused once retire_value, a graphics timeline value, has completed
+		void remove(BINDLESS_BINDING binding, uint32_t index, uint64_t retire_value);
+		void release_retired(uint64_t completed_value);
+
+		VkDescriptorSetLayout get_layout() const;
+		VkDescriptorSet get_set() const;
+		uint32_t capacity(BINDLESS_BINDING binding) const;
+
+	private:
+		struct Slots {
+			uint32_t capacity = 0;
+			uint32_t next = 0; // Never used slots start here
+			std::vector<uint32_t> free;
+		};
+
+		struct Retired {
+			BINDLESS_BINDING binding;
+			uint32_t index;
+			uint64_t value;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		VkDescriptorSet set = VK_NULL_HANDLE;
+
+		Slots slots[BINDLESS_BINDING_COUNT];
+		std::vector<Retired> retired;
+
+		uint32_t take_slot(BINDLESS_BINDING binding);
+		void write(BINDLESS_BINDING binding, uint32_t index, VkDescriptorType type,
+			const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info);
+	};
+
+}
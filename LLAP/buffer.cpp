@@ -0,0 +1,56 @@
+#include "buffer.h"
+
+namespace LLAP {
+
+	VkBuffer create_buffer_handle(
+		VkDevice device,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		const std::vector<uint32_t>& families)
+	{
+		VkBufferCreateInfo buffer_info{};
+		buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		buffer_info.size = size;
+		buffer_info.usage = usage;
+
+		if (families.size() > 1) {
+			buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+			buffer_info.pQueueFamilyIndices = families.data();
+		}
+		else {
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		}
+
+		VkBuffer buffer;
+		if (vkCreateBuffer(device, &buffer_info, host_callbacks(HOST_SCOPE_DEVICE), &buffer) != VK_SUCCESS) {
+			log("Failed to create buffer", ERROR);
+		}
+
+		return buffer;
+	}
+
+	Buffer create_buffer(
+		VkDevice device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags properties,
+		MEMORY_CATEGORY category,
+		const std::vector<uint32_t>& families)
+	{
+		Buffer buffer;
+		buffer.size = size;
+		buffer.buffer = create_buffer_handle(device, size, usage, families);
+		buffer.allocation = allocator.allocate_buffer(buffer.buffer, properties, category);
+
+		return buffer;
+	}
+
+	void destroy_buffer(VkDevice device, Allocator& allocator, Buffer& buffer) {
+		vkDestroyBuffer(device, buffer.buffer, host_callbacks(HOST_SCOPE_DEVICE));
+		allocator.free(buffer.allocation);
+		buffer = Buffer{};
+	}
+
+}
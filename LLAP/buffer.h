@@ -0,0 +1,37 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "allocator.h"
+
+namespace LLAP {
+
+	struct Buffer {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation allocation;
+		VkDeviceSize size = 0;
+	};
+
+	// More than one queue family makes the buffer concurrently shared between them
+	VkBuffer create_buffer_handle(
+		VkDevice device,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		const std::vector<uint32_t>& families = {});
+
+	Buffer create_buffer(
+		VkDevice device,
+		Allocator& allocator,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkMemoryPropertyFlags properties,
+		MEMORY_CATEGORY category,
+		const std::vector<uint32_t>& families = {});
+
+	void destroy_buffer(VkDevice device, Allocator& allocator, Buffer& buffer);
+
+}
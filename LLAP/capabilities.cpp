@@ -0,0 +1,172 @@
+#include "capabilities.h"
+
+#include <algorithm>
+
+namespace LLAP {
+
+	FeatureChain::FeatureChain() {
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		storage_16bit.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+		timeline_semaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		descriptor_indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+		buffer_device_address.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+		link(false, false, false);
+	}
+
+	void FeatureChain::link(bool with_16bit_storage, bool with_descriptor_indexing, bool with_buffer_device_address) {
+		void** next = &features.pNext;
+
+		if (with_16bit_storage) {
+			*next = &storage_16bit;
+			next = &storage_16bit.pNext;
+		}
+
+		*next = &timeline_semaphore;
+		next = &timeline_semaphore.pNext;
+
+		if (with_descriptor_indexing) {
+			*next = &descriptor_indexing;
+			next = &descriptor_indexing.pNext;
+		}
+
+		if (with_buffer_device_address) {
+			*next = &buffer_device_address;
+			next = &buffer_device_address.pNext;
+		}
+
+		*next = nullptr;
+	}
+
+	Capabilities negotiate_capabilities(
+		const DeviceSnapshot& snapshot,
+		FeatureChain& enabled,
+		std::vector<const char*>& extensions)
+	{
+		Capabilities capabilities;
+		capabilities.api_version = snapshot.properties.apiVersion;
+		bool vulkan_1_1 = snapshot.properties.apiVersion >= VK_API_VERSION_1_1;
+		bool vulkan_1_2 = snapshot.properties.apiVersion >= VK_API_VERSION_1_2;
+
+		// Enables an advertised extension once, promoted extensions stay optional on newer devices
+		auto enable_extension = [&](const char* name) {
+			if (!snapshot.has_extension(name)) {
+				return false;
+			}
+			if (std::none_of(extensions.begin(), extensions.end(),
+				[&](const char* enabled_name) { return std::string(enabled_name) == name; }))
+			{
+				extensions.push_back(name);
+			}
+			return true;
+		};
+
+		bool has_descriptor_indexing = vulkan_1_2 || snapshot.has_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		bool has_buffer_device_address = vulkan_1_2 || snapshot.has_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME);
+
+		const VkPhysicalDeviceFeatures& core = snapshot.features;
+		VkPhysicalDeviceFeatures& enabled_core = enabled.features.features;
+
+		// Core features
+		enabled_core.multiDrawIndirect = core.multiDrawIndirect;
+		enabled_core.drawIndirectFirstInstance = core.drawIndirectFirstInstance;
+		enabled_core.shaderInt16 = core.shaderInt16;
+		enabled_core.samplerAnisotropy = core.samplerAnisotropy;
+		enabled_core.shaderStorageImageWriteWithoutFormat = core.shaderStorageImageWriteWithoutFormat;
+		enabled_core.fragmentStoresAndAtomics = core.fragmentStoresAndAtomics;
+		enabled_core.textureCompressionBC = core.textureCompressionBC;
+		enabled_core.textureCompressionETC2 = core.textureCompressionETC2;
+		enabled_core.textureCompressionASTC_LDR = core.textureCompressionASTC_LDR;
+		if (core.sparseBinding && core.sparseResidencyImage2D) {
+			enabled_core.sparseBinding = VK_TRUE;
+			enabled_core.sparseResidencyImage2D = VK_TRUE;
+		}
+
+		capabilities.multi_draw_indirect = enabled_core.multiDrawIndirect;
+		capabilities.draw_indirect_first_instance = enabled_core.drawIndirectFirstInstance;
+		capabilities.shader_int16 = enabled_core.shaderInt16;
+		capabilities.sampler_anisotropy = enabled_core.samplerAnisotropy;
+		capabilities.storage_image_write_without_format = enabled_core.shaderStorageImageWriteWithoutFormat;
+		capabilities.fragment_stores_and_atomics = enabled_core.fragmentStoresAndAtomics;
+		capabilities.texture_compression_bc = enabled_core.textureCompressionBC;
+		capabilities.texture_compression_etc2 = enabled_core.textureCompressionETC2;
+		capabilities.texture_compression_astc = enabled_core.textureCompressionASTC_LDR;
+		capabilities.sparse_residency = enabled_core.sparseResidencyImage2D;
+
+		// Timeline semaphores are required, is_gpu_suitable checked the extension
+		enabled.timeline_semaphore.timelineSemaphore = snapshot.timeline_semaphore_features.timelineSemaphore;
+		capabilities.timeline_semaphore = enabled.timeline_semaphore.timelineSemaphore;
+
+		// Vulkan 1.1 core, the extension also needs storage buffer storage class
+		if (snapshot.storage_16bit_features.storageBuffer16BitAccess &&
+			(vulkan_1_1 || (snapshot.has_extension(VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME) &&
+				enable_extension(VK_KHR_16BIT_STORAGE_EXTENSION_NAME) &&
+				enable_extension(VK_KHR_STORAGE_BUFFER_STORAGE_CLASS_EXTENSION_NAME))))
+		{
+			enabled.storage_16bit.storageBuffer16BitAccess = VK_TRUE;
+			capabilities.storage_16bit = true;
+		}
+
+		capabilities.draw_indirect_count = enable_extension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+		// Only the subset the bindless tables rely on
+		const VkPhysicalDeviceDescriptorIndexingFeatures& indexing = snapshot.descriptor_indexing_features;
+		if (has_descriptor_indexing &&
+			indexing.runtimeDescriptorArray &&
+			indexing.descriptorBindingPartiallyBound &&
+			indexing.descriptorBindingVariableDescriptorCount &&
+			indexing.shaderSampledImageArrayNonUniformIndexing &&
+			indexing.descriptorBindingSampledImageUpdateAfterBind &&
+			indexing.descriptorBindingStorageBufferUpdateAfterBind &&
+			indexing.descriptorBindingUpdateUnusedWhilePending &&
+			(vulkan_1_2 || enable_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)))
+		{
+			capabilities.descriptor_indexing = true;
+			enabled.descriptor_indexing.runtimeDescriptorArray = VK_TRUE;
+			enabled.descriptor_indexing.descriptorBindingPartiallyBound = VK_TRUE;
+			enabled.descriptor_indexing.descriptorBindingVariableDescriptorCount = VK_TRUE;
+			enabled.descriptor_indexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			enabled.descriptor_indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+			enabled.descriptor_indexing.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+			enabled.descriptor_indexing.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+		}
+
+		if (has_buffer_device_address &&
+			snapshot.buffer_device_address_features.bufferDeviceAddress &&
+			(vulkan_1_2 || enable_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME)))
+		{
+			capabilities.buffer_device_address = true;
+			enabled.buffer_device_address.bufferDeviceAddress = VK_TRUE;
+		}
+
+		capabilities.memory_budget = enable_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		capabilities.push_descriptors = enable_extension(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+		enabled.link(capabilities.storage_16bit, capabilities.descriptor_indexing, capabilities.buffer_device_address);
+
+		if (capabilities.multi_draw_indirect && capabilities.draw_indirect_first_instance && capabilities.draw_indirect_count) {
+			capabilities.tier = TIER_INDIRECT;
+
+			if (capabilities.descriptor_indexing && capabilities.buffer_device_address) {
+				capabilities.tier = TIER_BINDLESS;
+			}
+		}
+
+		log("Device [" + static_cast<std::string>(snapshot.properties.deviceName) + "] capability tier: " + tier_name(capabilities.tier));
+
+		return capabilities;
+	}
+
+	std::string tier_name(CAPABILITY_TIER tier) {
+		switch (tier) {
+		case TIER_BASELINE:
+			return "baseline";
+		case TIER_INDIRECT:
+			return "indirect";
+		case TIER_BINDLESS:
+			return "bindless";
+		default:
+			return "unknown";
+		}
+	}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+
+#include "debug.h"
+#include "snapshot.h"
+
+namespace LLAP {
+
+	typedef enum CAPABILITY_TIER {
+		TIER_BASELINE, // Swap chain and timeline semaphores only
+		TIER_INDIRECT, // Multi draw indirect with a GPU written draw count
+		TIER_BINDLESS, // TIER_INDIRECT plus descriptor indexing and buffer device address
+	} CAPABILITY_TIER;
+
+	// Optional features enabled on the logical device. Engine code checks these
+	// rather than the physical device so every fast path degrades the same way.
+	struct Capabilities {
+		CAPABILITY_TIER tier = TIER_BASELINE;
+		uint32_t api_version = VK_API_VERSION_1_0;
+
+		bool multi_draw_indirect = false;
+		bool draw_indirect_first_instance = false;
+		bool draw_indirect_count = false;
+		bool timeline_semaphore = false;
+		bool descriptor_indexing = false;
+		bool buffer_device_address = false;
+		bool storage_16bit = false;
+		bool shader_int16 = false;
+		bool sampler_anisotropy = false;
+		bool storage_image_write_without_format = false;
+		bool fragment_stores_and_atomics = false;
+		bool texture_compression_bc = false;
+		bool texture_compression_etc2 = false;
+		bool texture_compression_astc = false;
+		bool sparse_residency = false;
+		bool memory_budget = false;
+		bool push_descriptors = false;
+	};
+
+	// Feature structures passed to vkGetPhysicalDeviceFeatures2 and vkCreateDevice.
+	// The pNext chain points into the object itself, so it can't be copied.
+	struct FeatureChain {
+		VkPhysicalDeviceFeatures2 features{};
+		VkPhysicalDevice16BitStorageFeatures storage_16bit{};
+		VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore{};
+		VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing{};
+		VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address{};
+
+		FeatureChain();
+		FeatureChain(const FeatureChain&) = delete;
+		FeatureChain& operator=(const FeatureChain&) = delete;
+
+		// Only structures whose extension (or core version) the device has may be chained
+		void link(bool with_16bit_storage, bool with_descriptor_indexing, bool with_buffer_device_address);
+	};
+
+	// Enables the optional features LLAP can use that the snapshot reports as
+	// supported, and appends the optional extensions they need to extensions
+	Capabilities negotiate_capabilities(
+		const DeviceSnapshot& snapshot,
+		FeatureChain& enabled,
+		std::vector<const char*>& extensions);
+
+	std::string tier_name(CAPABILITY_TIER tier);
+
+}
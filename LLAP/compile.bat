@@ -1,3 +1,5 @@
 C:\VulkanSDK\1.2.135.0\Bin\glslc shader.vert -o vert.spv
 C:\VulkanSDK\1.2.135.0\Bin\glslc shader.frag -o frag.spv
+C:\VulkanSDK\1.2.135.0\Bin\glslc downsample.comp -o downsample.spv
+C:\VulkanSDK\1.2.135.0\Bin\glslc quantized.vert -o quantized_vert.spv
 pause
\ No newline at end of file
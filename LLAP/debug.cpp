@@ -3,10 +3,14 @@
 namespace LLAP {
 
 	void log(const std::string& string, const TAG& tag) {
+		log(string.c_str(), tag);
+	}
+
+	void log(const char* string, const TAG& tag) {
 		auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 		auto time_s = std::put_time(std::localtime(&time), "%T");
 
-		std::string tag_s = "";
+		const char* tag_s = "";
 		switch (tag) {
 		case MESSAGE:
 			tag_s = "{MESSAGE}: ";
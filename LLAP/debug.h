@@ -14,5 +14,6 @@ namespace LLAP {
 	} TAG;
 
 	void log(const std::string& string, const TAG& tag = MESSAGE);
+	void log(const char* string, const TAG& tag = MESSAGE); // Doesn't allocate unless it throws
 
 }
\ No newline at end of file
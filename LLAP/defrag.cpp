@@ -0,0 +1,128 @@
+#include "defrag.h"
+
+#include <algorithm>
+
+namespace LLAP {
+
+	void Defragmenter::init(VkDevice device, Allocator* allocator) {
+		this->device = device;
+		this->allocator = allocator;
+	}
+
+	void Defragmenter::cleanup() {
+		for (auto& move : moves) {
+			destroy_buffer(device, *allocator, move.relocated);
+		}
+		moves.clear();
+
+		release_retired(UINT64_MAX);
+		tracked.clear();
+	}
+
+	void Defragmenter::track(Buffer* buffer, VkBufferUsageFlags usage, const std::vector<uint32_t>& families) {
+		tracked.push_back({ buffer, usage, families });
+	}
+
+	void Defragmenter::untrack(Buffer* buffer) {
+		tracked.erase(std::remove_if(tracked.begin(), tracked.end(),
+			[&](const Tracked& entry) { return entry.buffer == buffer; }), tracked.end());
+
+		for (auto& move : moves) {
+			if (move.target == buffer) {
+				move.target = nullptr;
+			}
+		}
+	}
+
+	uint32_t Defragmenter::candidate_block() const {
+		uint32_t source = allocator->sparsest_block(MAX_SOURCE_USAGE);
+		if (source == UINT32_MAX) {
+			return UINT32_MAX;
+		}
+
+		bool tracked_in_source = std::any_of(tracked.begin(), tracked.end(), [&](const Tracked& entry) {
+			return entry.buffer->allocation.block == source;
+		});
+		return tracked_in_source ? source : UINT32_MAX;
+	}
+
+	bool Defragmenter::has_candidate() const {
+		return moves.empty() && candidate_block() != UINT32_MAX;
+	}
+
+	bool Defragmenter::record_moves(VkCommandBuffer command_buffer, VkDeviceSize max_bytes) {
+		if (!moves.empty()) {
+			return false;
+		}
+
+		uint32_t source = candidate_block();
+		if (source == UINT32_MAX) {
+			return false;
+		}
+
+		VkDeviceSize recorded = 0;
+		for (auto& entry : tracked) {
+			if (recorded >= max_bytes) {
+				break;
+			}
+
+			Buffer& buffer = *entry.buffer;
+			if (buffer.allocation.block != source) {
+				continue;
+			}
+
+			Buffer relocated;
+			relocated.size = buffer.size;
+			relocated.buffer = create_buffer_handle(device, buffer.size, entry.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, entry.families);
+
+			// The other blocks are full, nothing more can leave this one
+			if (!allocator->relocate_buffer(relocated.buffer, buffer.allocation, relocated.allocation)) {
+				vkDestroyBuffer(device, relocated.buffer, host_callbacks(HOST_SCOPE_DEVICE));
+				break;
+			}
+
+			VkBufferCopy region{};
+			region.size = buffer.size;
+			vkCmdCopyBuffer(command_buffer, buffer.buffer, relocated.buffer, 1, &region);
+
+			moves.push_back({ entry.buffer, relocated });
+			recorded += buffer.size;
+		}
+
+		return !moves.empty();
+	}
+
+	VkDeviceSize Defragmenter::commit_moves(uint64_t retire_value) {
+		VkDeviceSize moved = 0;
+
+		for (auto& move : moves) {
+			if (move.target == nullptr) {
+				retired.push_back({ move.relocated, retire_value });
+				continue;
+			}
+
+			retired.push_back({ *move.target, retire_value });
+			*move.target = move.relocated;
+			moved += move.relocated.size;
+		}
+		moves.clear();
+
+		return moved;
+	}
+
+	void Defragmenter::release_retired(uint64_t completed_value) {
+		for (auto& entry : retired) {
+			if (entry.value <= completed_value) {
+				destroy_buffer(device, *allocator, entry.buffer);
+			}
+		}
+
+		retired.erase(std::remove_if(retired.begin(), retired.end(),
+			[](const Retired& entry) { return entry.buffer.buffer == VK_NULL_HANDLE; }), retired.end());
+	}
+
+	bool Defragmenter::moving() const {
+		return !moves.empty();
+	}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "allocator.h"
+#include "buffer.h"
+
+namespace LLAP {
+
+	// Incrementally empties sparse memory blocks by copying tracked buffers into
+	// other blocks. Copies are recorded a byte budget at a time, the caller swaps
+	// the handles in at a frame boundary once they completed, and the old buffers
+	// are destroyed once no submitted frame can still read them.
+	//
+	// Images aren't relocated, that would also need their BindlessTable
+	// descriptors patched at the frame boundary. Blocks of optimal tiling images,
+	// such as the TextureStreamer's, are never emptied.
+	class Defragmenter {
+	public:
+		void init(VkDevice device, Allocator* allocator);
+		void cleanup();
+
+		// The Buffer must keep its address while tracked and the GPU must never
+		// write to it, which holds for uploaded geometry
+		void track(Buffer* buffer, VkBufferUsageFlags usage, const std::vector<uint32_t>& families);
+		void untrack(Buffer* buffer);
+
+		// True when no batch is in flight and the sparsest block holds a tracked
+		// buffer, so record_moves has something to copy
+		bool has_candidate() const;
+
+		// Records copies out of the sparsest block, up to max_bytes. Returns false
+		// when nothing was recorded. Only one batch is in flight at a time.
+		bool record_moves(VkCommandBuffer command_buffer, VkDeviceSize max_bytes);
+
+		// Swaps in the copies of the recorded batch, which must have completed. The old
+		// buffers are destroyed by release_retired once retire_value has completed.
+		VkDeviceSize commit_moves(uint64_t retire_value);
+		void release_retired(uint64_t completed_value);
+
+		bool moving() const;
+
+	private:
+		// Blocks fuller than this aren't worth emptying
+		static constexpr float MAX_SOURCE_USAGE = 0.5f;
+
+		struct Tracked {
+			Buffer* buffer;
+			VkBufferUsageFlags usage;
+			std::vector<uint32_t> families;
+		};
+
+		struct Move {
+			Buffer* target; // nullptr when untracked mid move
+			Buffer relocated;
+		};
+
+		struct Retired {
+			Buffer buffer;
+			uint64_t value;
+		};
+
+		// Sparsest block holding a tracked buffer, UINT32_MAX if there is none
+		uint32_t candidate_block() const;
+
+		VkDevice device = VK_NULL_HANDLE;
+		Allocator* allocator = nullptr;
+		std::vector<Tracked> tracked;
+		std::vector<Move> moves;
+		std::vector<Retired> retired;
+	};
+
+}
@@ -0,0 +1,288 @@
+#include "descriptors.h"
+
+#include <algorithm>
+
+namespace LLAP {
+
+	// Descriptors of each type a pool holds per set
+	struct PoolRatio {
+		VkDescriptorType type;
+		float ratio;
+	};
+
+	static const PoolRatio POOL_RATIOS[] = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.0f },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 0.5f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 0.5f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0f },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f },
+	};
+
+	size_t descriptor_info_size(VkDescriptorType type) {
+		switch (type) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			return sizeof(VkDescriptorImageInfo);
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			return sizeof(VkBufferView);
+		default:
+			return sizeof(VkDescriptorBufferInfo);
+		}
+	}
+
+	DescriptorLayout& DescriptorLayout::binding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages,
+		size_t offset, uint32_t count)
+	{
+		VkDescriptorSetLayoutBinding layout_binding{};
+		layout_binding.binding = binding;
+		layout_binding.descriptorType = type;
+		layout_binding.descriptorCount = count;
+		layout_binding.stageFlags = stages;
+		bindings.push_back(layout_binding);
+
+		VkDescriptorUpdateTemplateEntry entry{};
+		entry.dstBinding = binding;
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = count;
+		entry.descriptorType = type;
+		entry.offset = offset;
+		entry.stride = descriptor_info_size(type);
+		entries.push_back(entry);
+
+		return *this;
+	}
+
+	void DescriptorLayout::create(VkDevice device, DESCRIPTOR_BACKEND backend) {
+		this->backend = backend;
+
+		VkDescriptorSetLayoutCreateInfo layout_info{};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		layout_info.pBindings = bindings.data();
+
+		if (backend == DESCRIPTOR_BACKEND_PUSH) {
+			for (const auto& layout_binding : bindings) {
+				if (layout_binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+					layout_binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
+				{
+					log("Push descriptor layouts can't have dynamic bindings", ERROR);
+				}
+			}
+
+			layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+			vk_cmd_push_descriptor_set_with_template = (PFN_vkCmdPushDescriptorSetWithTemplateKHR)
+				vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+		}
+
+		if (vkCreateDescriptorSetLayout(device, &layout_info, host_callbacks(HOST_SCOPE_PIPELINE), &layout) != VK_SUCCESS) {
+			log("Failed to create descriptor set layout", ERROR);
+		}
+
+		// Push templates also need the pipeline layout, attach() creates them
+		if (backend == DESCRIPTOR_BACKEND_POOL) {
+			create_template(device);
+		}
+	}
+
+	void DescriptorLayout::create_template(VkDevice device) {
+		// Empty layouts only fill a set number, there is nothing to update
+		if (entries.empty()) {
+			return;
+		}
+
+		VkDescriptorUpdateTemplateCreateInfo template_info{};
+		template_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+		template_info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+		template_info.pDescriptorUpdateEntries = entries.data();
+		if (backend == DESCRIPTOR_BACKEND_PUSH) {
+			template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+			template_info.pipelineBindPoint = bind_point;
+			template_info.pipelineLayout = pipeline_layout;
+			template_info.set = set_number;
+		}
+		else {
+			template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+			template_info.descriptorSetLayout = layout;
+		}
+
+		if (vkCreateDescriptorUpdateTemplate(device, &template_info, host_callbacks(HOST_SCOPE_PIPELINE), &update_template) != VK_SUCCESS) {
+			log("Failed to create descriptor update template", ERROR);
+		}
+	}
+
+	void DescriptorLayout::attach(VkDevice device, VkPipelineLayout pipeline_layout, uint32_t set_number,
+		VkPipelineBindPoint bind_point)
+	{
+		this->pipeline_layout = pipeline_layout;
+		this->set_number = set_number;
+		this->bind_point = bind_point;
+
+		if (backend == DESCRIPTOR_BACKEND_PUSH) {
+			vkDestroyDescriptorUpdateTemplate(device, update_template, host_callbacks(HOST_SCOPE_PIPELINE));
+			update_template = VK_NULL_HANDLE;
+			create_template(device);
+		}
+	}
+
+	void DescriptorLayout::destroy(VkDevice device) {
+		vkDestroyDescriptorUpdateTemplate(device, update_template, host_callbacks(HOST_SCOPE_PIPELINE));
+		vkDestroyDescriptorSetLayout(device, layout, host_callbacks(HOST_SCOPE_PIPELINE));
+		update_template = VK_NULL_HANDLE;
+		layout = VK_NULL_HANDLE;
+	}
+
+	void DescriptorLayout::update(VkDevice device, VkDescriptorSet set, const void* data) const {
+		vkUpdateDescriptorSetWithTemplate(device, set, update_template, data);
+	}
+
+	void DescriptorLayout::bind(VkCommandBuffer command_buffer, VkDescriptorSet set, const void* data,
+		uint32_t dynamic_offset_count, const uint32_t* dynamic_offsets) const
+	{
+		if (backend == DESCRIPTOR_BACKEND_PUSH) {
+			vk_cmd_push_descriptor_set_with_template(command_buffer, update_template, pipeline_layout, set_number, data);
+		}
+		else {
+			vkCmdBindDescriptorSets(command_buffer, bind_point, pipeline_layout, set_number,
+				1, &set, dynamic_offset_count, dynamic_offsets);
+		}
+	}
+
+	VkDescriptorSetLayout DescriptorLayout::get_layout() const {
+		return layout;
+	}
+
+	const std::vector<VkDescriptorSetLayoutBinding>& DescriptorLayout::get_bindings() const {
+		return bindings;
+	}
+
+	void DescriptorPool::init(VkDevice device, uint32_t initial_sets) {
+		this->device = device;
+		sets_per_pool = std::max(initial_sets, 1u);
+	}
+
+	void DescriptorPool::cleanup() {
+		reset();
+		for (VkDescriptorPool pool : ready) {
+			vkDestroyDescriptorPool(device, pool, host_callbacks(HOST_SCOPE_DEVICE));
+		}
+		ready.clear();
+	}
+
+	VkDescriptorPool DescriptorPool::create_pool(uint32_t sets) {
+		VkDescriptorPoolSize sizes[sizeof(POOL_RATIOS) / sizeof(POOL_RATIOS[0])];
+		uint32_t size_count = 0;
+		for (const auto& ratio : POOL_RATIOS) {
+			sizes[size_count].type = ratio.type;
+			sizes[size_count].descriptorCount = std::max(static_cast<uint32_t>(ratio.ratio * sets), 1u);
+			size_count++;
+		}
+
+		VkDescriptorPoolCreateInfo pool_info{};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = sets;
+		pool_info.poolSizeCount = size_count;
+		pool_info.pPoolSizes = sizes;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(device, &pool_info, host_callbacks(HOST_SCOPE_DEVICE), &pool) != VK_SUCCESS) {
+			log("Failed to create descriptor pool", ERROR);
+		}
+
+		return pool;
+	}
+
+	void DescriptorPool::next_pool() {
+		if (current != VK_NULL_HANDLE) {
+			full.push_back(current);
+		}
+
+		if (!ready.empty()) {
+			current = ready.back();
+			ready.pop_back();
+			return;
+		}
+
+		// Every pool after the first is twice as large, so only a few are ever needed
+		if (current != VK_NULL_HANDLE) {
+			sets_per_pool = std::min(sets_per_pool * 2, MAX_SETS_PER_POOL);
+		}
+		current = create_pool(sets_per_pool);
+	}
+
+	VkDescriptorSet DescriptorPool::allocate(VkDescriptorSetLayout layout) {
+		if (current == VK_NULL_HANDLE) {
+			next_pool();
+		}
+
+		VkDescriptorSetAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &layout;
+
+		VkDescriptorSet set;
+		for (uint32_t attempt = 0; attempt < 2; attempt++) {
+			alloc_info.descriptorPool = current;
+			VkResult result = vkAllocateDescriptorSets(device, &alloc_info, &set);
+			if (result == VK_SUCCESS) {
+				return set;
+			}
+			if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+				break;
+			}
+			next_pool();
+		}
+
+		log("Failed to allocate descriptor set", ERROR);
+		return VK_NULL_HANDLE;
+	}
+
+	void DescriptorPool::reset() {
+		if (current != VK_NULL_HANDLE) {
+			full.push_back(current);
+			current = VK_NULL_HANDLE;
+		}
+
+		for (VkDescriptorPool pool : full) {
+			vkResetDescriptorPool(device, pool, 0);
+			ready.push_back(pool);
+		}
+		full.clear();
+	}
+
+	void FrameDescriptors::init(VkDevice device, uint32_t frame_count, uint32_t thread_count, uint32_t initial_sets) {
+		this->thread_count = thread_count;
+		pools.resize(frame_count * thread_count);
+		for (auto& pool : pools) {
+			pool.init(device, initial_sets);
+		}
+	}
+
+	void FrameDescriptors::cleanup() {
+		for (auto& pool : pools) {
+			pool.cleanup();
+		}
+		pools.clear();
+	}
+
+	void FrameDescriptors::begin_frame(uint32_t frame) {
+		current_frame = frame;
+		for (uint32_t i = 0; i < thread_count; i++) {
+			pools[frame * thread_count + i].reset();
+		}
+	}
+
+	VkDescriptorSet FrameDescriptors::allocate(VkDescriptorSetLayout layout, uint32_t thread) {
+		return pools[current_frame * thread_count + thread].allocate(layout);
+	}
+
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "host_memory.h"
+
+namespace LLAP {
+
+	// Size of the info struct an update template reads for each descriptor of type
+	size_t descriptor_info_size(VkDescriptorType type);
+
+	typedef enum DESCRIPTOR_BACKEND {
+		DESCRIPTOR_BACKEND_POOL, // Sets allocated from a DescriptorPool, written once and bound
+		DESCRIPTOR_BACKEND_PUSH, // Written into the command buffer with VK_KHR_push_descriptor, no sets
+	} DESCRIPTOR_BACKEND;
+
+	// A descriptor set layout together with the update template that fills a set
+	// from one packed struct of VkDescriptorBufferInfo/VkDescriptorImageInfo/VkBufferView, e.g.
+	// layout.binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, offsetof(Data, camera));
+	class DescriptorLayout {
+	public:
+		// offset is where the binding's info structs start in the packed struct
+		DescriptorLayout& binding(uint32_t binding, VkDescriptorType type, VkShaderStageFlags stages,
+			size_t offset, uint32_t count = 1);
+
+		// Push layouts can't have dynamic bindings, put the offset in data instead
+		void create(VkDevice device, DESCRIPTOR_BACKEND backend = DESCRIPTOR_BACKEND_POOL);
+		void destroy(VkDevice device);
+
+		// The pipeline layout and set number bind() uses. Push layouts build
+		// their update template here, so call it before bind().
+		void attach(VkDevice device, VkPipelineLayout pipeline_layout, uint32_t set_number,
+			VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS);
+
+		// One call writes every binding of set from data
+		void update(VkDevice device, VkDescriptorSet set, const void* data) const;
+
+		// Pool layouts bind set, which update() wrote before. Push layouts write
+		// data into the command buffer instead and ignore set and dynamic offsets.
+		void bind(VkCommandBuffer command_buffer, VkDescriptorSet set, const void* data,
+			uint32_t dynamic_offset_count = 0, const uint32_t* dynamic_offsets = nullptr) const;
+
+		VkDescriptorSetLayout get_layout() const;
+		const std::vector<VkDescriptorSetLayoutBinding>& get_bindings() const;
+
+	private:
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		std::vector<VkDescriptorUpdateTemplateEntry> entries;
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+
+		DESCRIPTOR_BACKEND backend = DESCRIPTOR_BACKEND_POOL;
+		VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+		VkPipelineBindPoint bind_point = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		uint32_t set_number = 0;
+		PFN_vkCmdPushDescriptorSetWithTemplateKHR vk_cmd_push_descriptor_set_with_template = nullptr;
+
+		void create_template(VkDevice device);
+	};
+
+	// Allocates sets from a chain of descriptor pools, adding a pool twice the size
+	// of the last whenever the current one runs out. Sets are only freed all at once.
+	class DescriptorPool {
+	public:
+		void init(VkDevice device, uint32_t initial_sets);
+		void cleanup();
+
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+		void reset(); // Frees every set, the pools are kept for reuse
+
+	private:
+		static const uint32_t MAX_SETS_PER_POOL = 4096;
+
+		VkDevice device = VK_NULL_HANDLE;
+		uint32_t sets_per_pool = 0;
+		VkDescriptorPool current = VK_NULL_HANDLE;
+		std::vector<VkDescriptorPool> full;
+		std::vector<VkDescriptorPool> ready;
+
+		VkDescriptorPool create_pool(uint32_t sets);
+		void next_pool();
+	};
+
+	// A DescriptorPool per frame in flight and thread. Every thread allocates from
+	// its own so no locking is needed, and a frame's pools are reset together once
+	// the frame that last used them has completed.
+	class FrameDescriptors {
+	public:
+		void init(VkDevice device, uint32_t frame_count, uint32_t thread_count, uint32_t initial_sets = 64);
+		void cleanup();
+
+		void begin_frame(uint32_t frame);
+		VkDescriptorSet allocate(VkDescriptorSetLayout layout, uint32_t thread = 0);
+
+	private:
+		std::vector<DescriptorPool> pools; // frame * thread_count + thread
+		uint32_t thread_count = 0;
+		uint32_t current_frame = 0;
+	};
+
+}
@@ -0,0 +1,216 @@
+#include "host_memory.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace LLAP {
+
+	static HostAllocator& host_allocator() {
+		static HostAllocator allocator;
+		return allocator;
+	}
+
+	const VkAllocationCallbacks* host_callbacks(HOST_SCOPE scope) {
+		return host_allocator().callbacks(scope);
+	}
+
+	HostScopeStats host_memory_stats(HOST_SCOPE scope) {
+		return host_allocator().stats(scope);
+	}
+
+	size_t host_memory_bytes() {
+		return host_allocator().total_bytes();
+	}
+
+	void set_host_memory_limit(size_t bytes) {
+		host_allocator().set_limit(bytes);
+	}
+
+	const char* host_scope_name(HOST_SCOPE scope) {
+		switch (scope) {
+		case HOST_SCOPE_INSTANCE: return "instance";
+		case HOST_SCOPE_DEVICE: return "device";
+		case HOST_SCOPE_PIPELINE: return "pipeline";
+		case HOST_SCOPE_COMMAND: return "command";
+		default: return "unknown";
+		}
+	}
+
+	HostAllocator::HostAllocator() {
+		for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+			scopes[i].owner = this;
+			scopes[i].scope = static_cast<HOST_SCOPE>(i);
+
+			VkAllocationCallbacks& callbacks = scope_callbacks[i];
+			callbacks.pUserData = &scopes[i];
+			callbacks.pfnAllocation = allocation_callback;
+			callbacks.pfnReallocation = reallocation_callback;
+			callbacks.pfnFree = free_callback;
+			callbacks.pfnInternalAllocation = internal_allocation_callback;
+			callbacks.pfnInternalFree = internal_free_callback;
+		}
+	}
+
+	HostAllocator::~HostAllocator() {
+		for (char* memory : slabs) {
+			std::free(memory);
+		}
+	}
+
+	const VkAllocationCallbacks* HostAllocator::callbacks(HOST_SCOPE scope) const {
+		return &scope_callbacks[scope];
+	}
+
+	HostScopeStats HostAllocator::stats(HOST_SCOPE scope) const {
+		HostScopeStats stats;
+		stats.bytes = scopes[scope].bytes;
+		stats.peak = scopes[scope].peak;
+		stats.allocations = scopes[scope].allocations;
+		stats.internal_bytes = scopes[scope].internal_bytes;
+		return stats;
+	}
+
+	size_t HostAllocator::total_bytes() const {
+		return total;
+	}
+
+	void HostAllocator::set_limit(size_t bytes) {
+		limit = bytes;
+	}
+
+	void* HostAllocator::take_chunk(uint32_t size_class) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (free_lists[size_class] != nullptr) {
+			FreeChunk* chunk = free_lists[size_class];
+			free_lists[size_class] = chunk->next;
+			return chunk;
+		}
+
+		size_t chunk_size = MIN_CLASS_SIZE << size_class;
+		if (slab_head < chunk_size) {
+			// The rest of the slab is too small, it stays unused
+			slab = static_cast<char*>(std::malloc(SLAB_SIZE));
+			if (slab == nullptr) {
+				return nullptr;
+			}
+			slabs.push_back(slab);
+			slab_head = SLAB_SIZE;
+		}
+
+		slab_head -= chunk_size;
+		return slab + slab_head;
+	}
+
+	void* HostAllocator::allocate(Scope& scope, size_t size, size_t alignment) {
+		if (size == 0) {
+			return nullptr;
+		}
+
+		size_t current_limit = limit;
+		if (current_limit != 0 && total + size > current_limit) {
+			log(std::string("Host allocation of ") + std::to_string(size) + " bytes for " +
+				host_scope_name(scope.scope) + " exceeds the host memory limit", WARNING);
+			return nullptr;
+		}
+
+		// Room for the header and for aligning the pointer after it
+		size_t needed = size + sizeof(Header) + alignment - 1;
+		uint32_t size_class = 0;
+		while (size_class < CLASS_COUNT && (MIN_CLASS_SIZE << size_class) < needed) {
+			size_class++;
+		}
+
+		void* chunk = size_class < CLASS_COUNT ? take_chunk(size_class) : std::malloc(needed);
+		if (chunk == nullptr) {
+			return nullptr;
+		}
+
+		uintptr_t address = reinterpret_cast<uintptr_t>(chunk) + sizeof(Header);
+		address = (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+
+		Header* header = reinterpret_cast<Header*>(address) - 1;
+		header->chunk = chunk;
+		header->size = size;
+		header->size_class = size_class;
+		header->scope = scope.scope;
+
+		size_t bytes = scope.bytes += size;
+		size_t peak = scope.peak;
+		while (bytes > peak && !scope.peak.compare_exchange_weak(peak, bytes)) {}
+		scope.allocations++;
+		total += size;
+
+		return reinterpret_cast<void*>(address);
+	}
+
+	void* HostAllocator::reallocate(Scope& scope, void* original, size_t size, size_t alignment) {
+		if (original == nullptr) {
+			return allocate(scope, size, alignment);
+		}
+		if (size == 0) {
+			free(original);
+			return nullptr;
+		}
+
+		// On failure the original must stay valid, so allocate before freeing
+		void* memory = allocate(scope, size, alignment);
+		if (memory == nullptr) {
+			return nullptr;
+		}
+
+		const Header* header = static_cast<const Header*>(original) - 1;
+		std::memcpy(memory, original, std::min(header->size, size));
+		free(original);
+
+		return memory;
+	}
+
+	void HostAllocator::free(void* memory) {
+		if (memory == nullptr) {
+			return;
+		}
+
+		Header header = *(static_cast<Header*>(memory) - 1);
+		scopes[header.scope].bytes -= header.size;
+		total -= header.size;
+
+		if (header.size_class == CLASS_COUNT) {
+			std::free(header.chunk);
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		FreeChunk* chunk = static_cast<FreeChunk*>(header.chunk);
+		chunk->next = free_lists[header.size_class];
+		free_lists[header.size_class] = chunk;
+	}
+
+	void* VKAPI_CALL HostAllocator::allocation_callback(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope) {
+		Scope& scope = *static_cast<Scope*>(user_data);
+		return scope.owner->allocate(scope, size, alignment);
+	}
+
+	void* VKAPI_CALL HostAllocator::reallocation_callback(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope) {
+		Scope& scope = *static_cast<Scope*>(user_data);
+		return scope.owner->reallocate(scope, original, size, alignment);
+	}
+
+	void VKAPI_CALL HostAllocator::free_callback(void* user_data, void* memory) {
+		Scope& scope = *static_cast<Scope*>(user_data);
+		scope.owner->free(memory);
+	}
+
+	void VKAPI_CALL HostAllocator::internal_allocation_callback(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope) {
+		Scope& scope = *static_cast<Scope*>(user_data);
+		scope.internal_bytes += size;
+	}
+
+	void VKAPI_CALL HostAllocator::internal_free_callback(void* user_data, size_t size, VkInternalAllocationType, VkSystemAllocationScope) {
+		Scope& scope = *static_cast<Scope*>(user_data);
+		scope.internal_bytes -= size;
+	}
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "debug.h"
+
+namespace LLAP {
+
+	// Which kind of Vulkan object a driver host allocation is made for
+	typedef enum HOST_SCOPE {
+		HOST_SCOPE_INSTANCE,
+		HOST_SCOPE_DEVICE,
+		HOST_SCOPE_PIPELINE, // Pipelines, their layouts and shader modules
+		HOST_SCOPE_COMMAND, // Command pools, including what recording allocates
+		HOST_SCOPE_COUNT,
+	} HOST_SCOPE;
+
+	const char* host_scope_name(HOST_SCOPE scope);
+
+	struct HostScopeStats {
+		size_t bytes = 0; // Live bytes handed to the driver
+		size_t peak = 0;
+		size_t allocations = 0; // Total number made, not the live count
+		size_t internal_bytes = 0; // Memory the driver allocated itself and reported
+	};
+
+	// VkAllocationCallbacks for every object created by the engine. Small
+	// allocations come from size class free lists carved out of slabs, large ones
+	// from the heap. Usage is accounted per scope, and allocations past the limit
+	// fail so the driver returns VK_ERROR_OUT_OF_HOST_MEMORY.
+	const VkAllocationCallbacks* host_callbacks(HOST_SCOPE scope);
+	HostScopeStats host_memory_stats(HOST_SCOPE scope);
+	size_t host_memory_bytes(); // Over all scopes
+	void set_host_memory_limit(size_t bytes); // 0 for none
+
+	class HostAllocator {
+	public:
+		HostAllocator();
+		~HostAllocator();
+
+		HostAllocator(const HostAllocator&) = delete;
+		HostAllocator& operator=(const HostAllocator&) = delete;
+
+		const VkAllocationCallbacks* callbacks(HOST_SCOPE scope) const;
+		HostScopeStats stats(HOST_SCOPE scope) const;
+		size_t total_bytes() const;
+		void set_limit(size_t bytes);
+
+	private:
+		static const size_t MIN_CLASS_SIZE = 64;
+		static const uint32_t CLASS_COUNT = 7; // 64 B to 4 KiB
+		static const size_t SLAB_SIZE = 64 * 1024;
+
+		struct Scope {
+			HostAllocator* owner;
+			HOST_SCOPE scope;
+			std::atomic<size_t> bytes{ 0 };
+			std::atomic<size_t> peak{ 0 };
+			std::atomic<size_t> allocations{ 0 };
+			std::atomic<size_t> internal_bytes{ 0 };
+		};
+
+		// Placed right before every pointer handed out
+		struct Header {
+			void* chunk;
+			size_t size;
+			uint32_t size_class; // CLASS_COUNT for heap allocations
+			HOST_SCOPE scope;
+		};
+
+		struct FreeChunk {
+			FreeChunk* next;
+		};
+
+		Scope scopes[HOST_SCOPE_COUNT];
+		VkAllocationCallbacks scope_callbacks[HOST_SCOPE_COUNT];
+
+		std::mutex mutex; // Guards the free lists and slabs
+		FreeChunk* free_lists[CLASS_COUNT] = {};
+		char* slab = nullptr; // Chunks are carved from the end of the current slab
+		size_t slab_head = 0;
+		std::vector<char*> slabs;
+
+		std::atomic<size_t> total{ 0 };
+		std::atomic<size_t> limit{ 0 };
+
+		void* allocate(Scope& scope, size_t size, size_t alignment);
+		void* reallocate(Scope& scope, void* original, size_t size, size_t alignment);
+		void free(void* memory);
+		void* take_chunk(uint32_t size_class);
+
+		static void* VKAPI_CALL allocation_callback(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope allocation_scope);
+		static void* VKAPI_CALL reallocation_callback(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope allocation_scope);
+		static void VKAPI_CALL free_callback(void* user_data, void* memory);
+		static void VKAPI_CALL internal_allocation_callback(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope allocation_scope);
+		static void VKAPI_CALL internal_free_callback(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope allocation_scope);
+	};
+
+}
@@ -0,0 +1,169 @@
+#include "image.h"
+
+#include <algorithm>
+
+namespace LLAP {
+
+	bool format_block(VkFormat format, FormatBlock& block) {
+		// ASTC formats come in UNORM/SRGB pairs of increasing block size, all 16 bytes
+		static const uint32_t ASTC_BLOCKS[][2] = {
+			{ 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+			{ 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+		};
+		if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+			const uint32_t* size = ASTC_BLOCKS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+			block = { size[0], size[1], 16 };
+			return true;
+		}
+
+		switch (format) {
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+		case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+		case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+			block = { 4, 4, 8 };
+			return true;
+		case VK_FORMAT_BC2_UNORM_BLOCK:
+		case VK_FORMAT_BC2_SRGB_BLOCK:
+		case VK_FORMAT_BC3_UNORM_BLOCK:
+		case VK_FORMAT_BC3_SRGB_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK:
+		case VK_FORMAT_BC5_SNORM_BLOCK:
+		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+		case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+		case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+			block = { 4, 4, 16 };
+			return true;
+		case VK_FORMAT_R8_UNORM:
+		case VK_FORMAT_R8_SRGB:
+			block = { 1, 1, 1 };
+			return true;
+		case VK_FORMAT_R8G8_UNORM:
+		case VK_FORMAT_R8G8_SRGB:
+		case VK_FORMAT_R16_SFLOAT:
+			block = { 1, 1, 2 };
+			return true;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+		case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+		case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+		case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_R32_SFLOAT:
+			block = { 1, 1, 4 };
+			return true;
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R32G32_SFLOAT:
+			block = { 1, 1, 8 };
+			return true;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			block = { 1, 1, 16 };
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	VkDeviceSize level_size(const FormatBlock& block, VkExtent2D extent) {
+		VkDeviceSize columns = (extent.width + block.width - 1) / block.width;
+		VkDeviceSize rows = (extent.height + block.height - 1) / block.height;
+		return columns * rows * block.bytes;
+	}
+
+	VkExtent2D mip_extent(VkExtent2D extent, uint32_t level) {
+		return { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+	}
+
+	uint32_t mip_count(VkExtent2D extent) {
+		uint32_t levels = 1;
+		for (uint32_t size = std::max(extent.width, extent.height); size > 1; size >>= 1) {
+			levels++;
+		}
+		return levels;
+	}
+
+	Image create_image(
+		VkDevice device,
+		Allocator& allocator,
+		VkExtent2D extent,
+		uint32_t mip_levels,
+		VkFormat format,
+		VkImageUsageFlags usage,
+		MEMORY_CATEGORY category,
+		const std::vector<uint32_t>& families,
+		uint32_t layers)
+	{
+		Image image;
+		image.format = format;
+		image.extent = extent;
+		image.mip_levels = mip_levels;
+		image.layers = layers;
+
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = format;
+		image_info.extent = { extent.width, extent.height, 1 };
+		image_info.mipLevels = mip_levels;
+		image_info.arrayLayers = layers;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = usage;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (families.size() > 1) {
+			image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			image_info.queueFamilyIndexCount = static_cast<uint32_t>(families.size());
+			image_info.pQueueFamilyIndices = families.data();
+		}
+		else {
+			image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		}
+
+		if (vkCreateImage(device, &image_info, host_callbacks(HOST_SCOPE_DEVICE), &image.image) != VK_SUCCESS) {
+			log("Failed to create image", ERROR);
+		}
+
+		image.allocation = allocator.allocate_image(image.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, category);
+
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = image.image;
+		view_info.viewType = layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = mip_levels;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = layers;
+
+		if (vkCreateImageView(device, &view_info, host_callbacks(HOST_SCOPE_DEVICE), &image.view) != VK_SUCCESS) {
+			log("Failed to create image view", ERROR);
+		}
+
+		return image;
+	}
+
+	void destroy_image(VkDevice device, Allocator& allocator, Image& image) {
+		vkDestroyImageView(device, image.view, host_callbacks(HOST_SCOPE_DEVICE));
+		vkDestroyImage(device, image.image, host_callbacks(HOST_SCOPE_DEVICE));
+		allocator.free(image.allocation);
+		image = Image{};
+	}
+
+}
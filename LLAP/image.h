@@ -0,0 +1,55 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "allocator.h"
+
+namespace LLAP {
+
+	// A 2D device local image with a view over all of its mips, a 2D array view
+	// when it has more than one layer
+	struct Image {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		Allocation allocation;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = { 0, 0 };
+		uint32_t mip_levels = 0;
+		uint32_t layers = 1;
+	};
+
+	// Texel block of a format, 1x1 for uncompressed ones
+	struct FormatBlock {
+		uint32_t width = 1;
+		uint32_t height = 1;
+		uint32_t bytes = 0;
+	};
+
+	// False for formats LLAP doesn't know the block layout of
+	bool format_block(VkFormat format, FormatBlock& block);
+	// Bytes of a tightly packed level of extent
+	VkDeviceSize level_size(const FormatBlock& block, VkExtent2D extent);
+
+	// Extent of mip level of an image of extent, never below 1
+	VkExtent2D mip_extent(VkExtent2D extent, uint32_t level);
+	uint32_t mip_count(VkExtent2D extent);
+
+	// More than one queue family makes the image concurrently shared between them
+	Image create_image(
+		VkDevice device,
+		Allocator& allocator,
+		VkExtent2D extent,
+		uint32_t mip_levels,
+		VkFormat format,
+		VkImageUsageFlags usage,
+		MEMORY_CATEGORY category,
+		const std::vector<uint32_t>& families = {},
+		uint32_t layers = 1);
+
+	void destroy_image(VkDevice device, Allocator& allocator, Image& image);
+
+}
@@ -0,0 +1,103 @@
+#include "io.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI // Keeps ERROR from being defined
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace LLAP {
+
+	MappedFile::MappedFile(const std::string& file_name) {
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) {
+			log("Failed to open file " + file_name, ERROR);
+		}
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(handle, &file_size)) {
+			CloseHandle(handle);
+			log("Failed to read the size of file " + file_name, ERROR);
+		}
+		file = handle;
+		length = static_cast<size_t>(file_size.QuadPart);
+		if (length == 0) {
+			return;
+		}
+
+		mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping != nullptr) {
+			memory = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+#else
+		int descriptor = open(file_name.c_str(), O_RDONLY);
+		if (descriptor < 0) {
+			log("Failed to open file " + file_name, ERROR);
+		}
+
+		struct stat file_stat;
+		if (fstat(descriptor, &file_stat) != 0) {
+			close(descriptor);
+			log("Failed to read the size of file " + file_name, ERROR);
+		}
+		length = static_cast<size_t>(file_stat.st_size);
+		if (length == 0) {
+			close(descriptor);
+			return;
+		}
+
+		// The mapping keeps the file open
+		void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		close(descriptor);
+		if (view != MAP_FAILED) {
+			memory = static_cast<const char*>(view);
+		}
+#endif
+
+		if (memory == nullptr) {
+			unmap();
+			log("Failed to map file " + file_name, ERROR);
+		}
+	}
+
+	MappedFile::~MappedFile() {
+		unmap();
+	}
+
+	void MappedFile::unmap() {
+#ifdef _WIN32
+		if (memory != nullptr) {
+			UnmapViewOfFile(memory);
+		}
+		if (mapping != nullptr) {
+			CloseHandle(mapping);
+		}
+		if (file != nullptr) {
+			CloseHandle(file);
+		}
+#else
+		if (memory != nullptr) {
+			munmap(const_cast<char*>(memory), length);
+		}
+#endif
+		memory = nullptr;
+		mapping = nullptr;
+		file = nullptr;
+	}
+
+	const char* MappedFile::data() const {
+		return memory;
+	}
+
+	size_t MappedFile::size() const {
+		return length;
+	}
+
+}
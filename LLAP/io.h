@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <vector>
+#include <string>
 
 #include "debug.h"
 
@@ -25,4 +26,25 @@ namespace LLAP {
 		return buffer;
 	}
 
+	// A read-only mapping of a whole file. Pages are read from the page cache
+	// the first time they are touched, so unused parts cost nothing.
+	class MappedFile {
+	public:
+		explicit MappedFile(const std::string& file_name);
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const char* data() const;
+		size_t size() const;
+
+	private:
+		const char* memory = nullptr;
+		size_t length = 0;
+		void* file = nullptr; // Windows handles, unused elsewhere
+		void* mapping = nullptr;
+
+		void unmap();
+	};
+
 }
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include "ktx.h"
+
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <numeric>
+
+namespace LLAP {
+
+	static const unsigned char KTX2_IDENTIFIER[12] = {
+		0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+	};
+
+	// File layout up to the level index, all little endian
+	struct Ktx2Header {
+		unsigned char identifier[12];
+		uint32_t vk_format;
+		uint32_t type_size;
+		uint32_t pixel_width;
+		uint32_t pixel_height;
+		uint32_t pixel_depth;
+		uint32_t layer_count;
+		uint32_t face_count;
+		uint32_t level_count;
+		uint32_t supercompression_scheme;
+		uint32_t dfd_byte_offset;
+		uint32_t dfd_byte_length;
+		uint32_t kvd_byte_offset;
+		uint32_t kvd_byte_length;
+		uint64_t sgd_byte_offset;
+		uint64_t sgd_byte_length;
+	};
+
+	struct Ktx2Level {
+		uint64_t byte_offset;
+		uint64_t byte_length;
+		uint64_t uncompressed_byte_length;
+	};
+
+	static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must match the file layout");
+	static_assert(sizeof(Ktx2Level) == 24, "KTX2 level index must match the file layout");
+
+	TextureData load_ktx2(const std::string& path, VkPhysicalDevice physical_device, const Ktx2Decoder& decoder) {
+		auto file = std::make_shared<const MappedFile>(path);
+
+		Ktx2Header header;
+		if (file->size() < sizeof(header)) {
+			log("Not a KTX2 file: " + path, ERROR);
+		}
+		std::memcpy(&header, file->data(), sizeof(header));
+
+		if (std::memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+			log("Not a KTX2 file: " + path, ERROR);
+		}
+		if (header.pixel_height == 0 || header.pixel_depth > 1 || header.face_count != 1) {
+			log("Only 2D KTX2 textures and arrays are supported: " + path, ERROR);
+		}
+
+		VkFormat format = static_cast<VkFormat>(header.vk_format);
+		FormatBlock block;
+		if (!format_block(format, block)) {
+			log("Unsupported KTX2 format " + std::to_string(header.vk_format) + ": " + path, ERROR);
+		}
+
+		// BCn, ETC2 and ASTC are each optional, the device has to sample the payload as is
+		if (physical_device != VK_NULL_HANDLE) {
+			VkFormatProperties format_properties;
+			vkGetPhysicalDeviceFormatProperties(physical_device, format, &format_properties);
+			VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+			if ((format_properties.optimalTilingFeatures & required) != required) {
+				log("The device can't sample KTX2 format " + std::to_string(header.vk_format) + ": " + path, ERROR);
+			}
+		}
+
+		KTX2_SUPERCOMPRESSION scheme = static_cast<KTX2_SUPERCOMPRESSION>(header.supercompression_scheme);
+		if (scheme != KTX2_SUPERCOMPRESSION_NONE &&
+			(scheme == KTX2_SUPERCOMPRESSION_BASISLZ || scheme > KTX2_SUPERCOMPRESSION_ZLIB || !decoder))
+		{
+			log("Unsupported KTX2 supercompression " + std::to_string(header.supercompression_scheme) + ": " + path, ERROR);
+		}
+
+		TextureData data;
+		data.format = format;
+		data.extent = { header.pixel_width, header.pixel_height };
+		data.layer_count = std::max(header.layer_count, 1u);
+
+		uint32_t level_count = std::max(header.level_count, 1u);
+		if (level_count > mip_count(data.extent) || file->size() < sizeof(header) + level_count * sizeof(Ktx2Level)) {
+			log("Corrupt KTX2 level index: " + path, ERROR);
+		}
+
+		std::vector<Ktx2Level> levels(level_count);
+		std::memcpy(levels.data(), file->data() + sizeof(header), level_count * sizeof(Ktx2Level));
+
+		// Sizes are checked up front, the uploader copies whole levels
+		VkDeviceSize uncompressed_size = 0;
+		for (uint32_t i = 0; i < level_count; i++) {
+			const Ktx2Level& level = levels[i];
+			VkDeviceSize expected = level_size(block, mip_extent(data.extent, i)) * data.layer_count;
+			VkDeviceSize length = scheme == KTX2_SUPERCOMPRESSION_NONE ? level.byte_length : level.uncompressed_byte_length;
+			if (level.byte_offset > file->size() || level.byte_length > file->size() - level.byte_offset || length != expected) {
+				log("Corrupt KTX2 level " + std::to_string(i) + ": " + path, ERROR);
+			}
+
+			data.level_offsets.push_back(uncompressed_size);
+			data.level_sizes.push_back(expected);
+			uncompressed_size += expected;
+		}
+
+		if (scheme == KTX2_SUPERCOMPRESSION_NONE) {
+			for (uint32_t i = 0; i < level_count; i++) {
+				data.level_offsets[i] = levels[i].byte_offset;
+			}
+			data.file = file;
+			return data;
+		}
+
+		// Every level inflates on its own thread, the finest takes about three quarters of the time
+		data.bytes.resize(static_cast<size_t>(uncompressed_size));
+		std::vector<std::future<void>> decoded;
+		for (uint32_t i = 0; i < level_count; i++) {
+			const char* src = file->data() + levels[i].byte_offset;
+			size_t src_size = static_cast<size_t>(levels[i].byte_length);
+			char* dst = data.bytes.data() + data.level_offsets[i];
+			size_t dst_size = static_cast<size_t>(data.level_sizes[i]);
+
+			decoded.push_back(std::async(std::launch::async, [&decoder, scheme, src, src_size, dst, dst_size] {
+				decoder(scheme, src, src_size, dst, dst_size);
+			}));
+		}
+		for (auto& level : decoded) {
+			level.get();
+		}
+
+		return data;
+	}
+
+	void write_ktx2(const std::string& path, const TextureData& data) {
+		FormatBlock block;
+		if (!format_block(data.format, block)) {
+			log("Can't write KTX2 format " + std::to_string(data.format), ERROR);
+		}
+
+		uint32_t level_count = data.level_count();
+		std::vector<Ktx2Level> levels(level_count);
+
+		// A basic descriptor block without samples, just the block size and bytes
+		uint32_t dfd[7] = {};
+		dfd[0] = sizeof(dfd);
+		dfd[2] = 2 | (24u << 16); // Version 2, 24 byte block
+		dfd[3] = 1u << 8 | 1u << 16; // BT.709 primaries, linear transfer
+		dfd[4] = (block.width - 1) | ((block.height - 1) << 8);
+		dfd[5] = block.bytes;
+
+		Ktx2Header header{};
+		std::memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+		header.vk_format = static_cast<uint32_t>(data.format);
+		header.type_size = 1;
+		header.pixel_width = data.extent.width;
+		header.pixel_height = data.extent.height;
+		header.layer_count = data.layer_count > 1 ? data.layer_count : 0;
+		header.face_count = 1;
+		header.level_count = level_count;
+		header.supercompression_scheme = KTX2_SUPERCOMPRESSION_NONE;
+		header.dfd_byte_offset = static_cast<uint32_t>(sizeof(header) + sizeof(Ktx2Level) * level_count);
+		header.dfd_byte_length = sizeof(dfd);
+
+		// Levels are stored smallest first, each aligned to its texel blocks
+		uint64_t alignment = std::lcm<uint64_t>(block.bytes, 4);
+		uint64_t offset = header.dfd_byte_offset + header.dfd_byte_length;
+		for (uint32_t i = level_count; i > 0; i--) {
+			offset = (offset + alignment - 1) / alignment * alignment;
+			levels[i - 1].byte_offset = offset;
+			levels[i - 1].byte_length = data.level_sizes[i - 1];
+			levels[i - 1].uncompressed_byte_length = data.level_sizes[i - 1];
+			offset += data.level_sizes[i - 1];
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			log("Failed to open file", ERROR);
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levels.data()), sizeof(Ktx2Level) * level_count);
+		file.write(reinterpret_cast<const char*>(dfd), sizeof(dfd));
+
+		uint64_t written = header.dfd_byte_offset + header.dfd_byte_length;
+		const char zeros[16] = {};
+		for (uint32_t i = level_count; i > 0; i--) {
+			file.write(zeros, static_cast<std::streamsize>(levels[i - 1].byte_offset - written));
+			file.write(data.level_data(i - 1), static_cast<std::streamsize>(data.level_sizes[i - 1]));
+			written = levels[i - 1].byte_offset + data.level_sizes[i - 1];
+		}
+
+		if (!file) {
+			log("Failed to write " + path, ERROR);
+		}
+	}
+
+	TextureLoader ktx2_loader(VkPhysicalDevice physical_device, Ktx2Decoder decoder) {
+		return [physical_device, decoder](const std::string& path) {
+			return load_ktx2(path, physical_device, decoder);
+		};
+	}
+
+}
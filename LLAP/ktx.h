@@ -0,0 +1,39 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <functional>
+
+#include "debug.h"
+#include "texture.h"
+
+namespace LLAP {
+
+	typedef enum KTX2_SUPERCOMPRESSION {
+		KTX2_SUPERCOMPRESSION_NONE = 0,
+		KTX2_SUPERCOMPRESSION_BASISLZ = 1, // Needs transcoding, not supported
+		KTX2_SUPERCOMPRESSION_ZSTD = 2,
+		KTX2_SUPERCOMPRESSION_ZLIB = 3,
+	} KTX2_SUPERCOMPRESSION;
+
+	// Inflates one supercompressed level into dst, which is exactly the level's
+	// uncompressed size. Called from several threads at once.
+	typedef std::function<void(KTX2_SUPERCOMPRESSION scheme, const char* src, size_t src_size,
+		char* dst, size_t dst_size)> Ktx2Decoder;
+
+	// Reads a 2D KTX2 texture or array whose format physical_device can sample,
+	// offline tools pass VK_NULL_HANDLE to skip that check. Levels without
+	// supercompression stay in the mapped file and are copied from it straight
+	// into staging. Supercompressed levels are inflated in parallel through
+	// decoder, which may be empty when no texture needs it.
+	TextureData load_ktx2(const std::string& path, VkPhysicalDevice physical_device, const Ktx2Decoder& decoder);
+
+	// Writes data without supercompression. The data format descriptor only
+	// describes the texel block, readers go by vkFormat.
+	void write_ktx2(const std::string& path, const TextureData& data);
+
+	TextureLoader ktx2_loader(VkPhysicalDevice physical_device, Ktx2Decoder decoder = nullptr);
+
+}
@@ -1,21 +1,119 @@
 #include "program.h"
+#include "atlas.h"
+#include "obj.h"
+#include "mesh_optimize.h"
+#include "mesh_quantize.h"
 
 #include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
 
 #include <memory>
+#include <cstddef>
+#include <cstring>
 
 class Triangle : public LLAP::Program {
-	void init() override {};
-	void loop() override {};
+	struct Vertex {
+		glm::vec2 position;
+		glm::vec3 color;
+	};
+
+	struct FrameUniforms {
+		glm::mat4 transform;
+	};
+
+	void init() override {
+		const std::vector<Vertex> vertices = {
+			{ { 0.0f, -0.5f }, { 1.0f, 0.0f, 0.0f } },
+			{ { 0.5f, 0.5f }, { 0.0f, 1.0f, 0.0f } },
+			{ { -0.5f, 0.5f }, { 0.0f, 0.0f, 1.0f } },
+		};
+		const std::vector<uint32_t> indices = { 0, 1, 2 };
+
+		add_mesh(vertices.data(), sizeof(Vertex) * vertices.size(), indices.data(), static_cast<uint32_t>(indices.size()));
+	};
+	void loop() override {
+		FrameUniforms uniforms;
+		uniforms.transform = glm::rotate(glm::mat4(1.0f), static_cast<float>(glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
+		std::memcpy(frame_uniforms(), &uniforms, sizeof(uniforms));
+	};
 	void cleanup() override {};
 public:
+	Triangle() {
+		vertex_layout.binding(sizeof(Vertex))
+			.attribute(0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position))
+			.attribute(1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color));
+		frame_uniform_size = sizeof(FrameUniforms);
+	}
 };
 
-int main() {
+// LLAP pack-atlas <output> <texture.ktx2>... writes <output>.ktx2 and its remap table <output>.atlas
+static int pack_atlas(int argc, char** argv) {
+	if (argc < 4) {
+		std::cerr << "Usage: " << argv[0] << " pack-atlas <output> <texture.ktx2>..." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::vector<std::string> names;
+	std::vector<LLAP::TextureData> textures;
+	for (int i = 3; i < argc; i++) {
+		names.push_back(argv[i]);
+		textures.push_back(LLAP::load_ktx2(argv[i], VK_NULL_HANDLE, nullptr));
+	}
+
+	std::vector<LLAP::AtlasRect> rects;
+	LLAP::TextureData atlas = LLAP::pack_atlas(textures, LLAP::AtlasSettings(), rects);
+	LLAP::write_ktx2(std::string(argv[2]) + ".ktx2", atlas);
+	LLAP::write_atlas_table(std::string(argv[2]) + ".atlas", names, rects);
+
+	std::cout << "Packed " << textures.size() << " textures into " << atlas.layer_count << " layers" << std::endl;
+	return EXIT_SUCCESS;
+}
+
+// LLAP convert-mesh [--quantize] <input.obj> <output.llmesh>
+static int convert_mesh(int argc, char** argv) {
+	bool quantize = argc == 5 && std::strcmp(argv[2], "--quantize") == 0;
+	if (argc != 4 && !quantize) {
+		std::cerr << "Usage: " << argv[0] << " convert-mesh [--quantize] <input.obj> <output.llmesh>" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const char* input = argv[argc - 2];
+	const char* output = argv[argc - 1];
+
+	LLAP::MeshData mesh = LLAP::load_obj(input);
+	LLAP::MeshOptimizeReport report = LLAP::optimize_mesh(mesh);
+	size_t float_size = mesh.vertices.size();
+	if (quantize) {
+		LLAP::quantize_mesh(mesh);
+	}
+	LLAP::write_mesh(output, mesh);
+
+	std::cout << "Converted " << mesh.vertex_count() << " vertices and " << mesh.indices.size() << " indices" << std::endl;
+	std::cout << "Vertices " << report.vertices_before << " -> " << report.vertices_after
+		<< ", ACMR " << report.before.acmr << " -> " << report.after.acmr
+		<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+	if (quantize) {
+		std::cout << "Quantized vertex stream " << float_size << " -> " << mesh.vertices.size() << " bytes" << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	// Offline tools, they don't open a window or create a device
+	if (argc > 1 && (std::strcmp(argv[1], "pack-atlas") == 0 || std::strcmp(argv[1], "convert-mesh") == 0)) {
+		try {
+			return std::strcmp(argv[1], "pack-atlas") == 0 ? pack_atlas(argc, argv) : convert_mesh(argc, argv);
+		}
+		catch (const std::exception& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
 	auto program = std::make_unique<Triangle>();
 	
 	try {
@@ -0,0 +1,38 @@
+#include "mesh.h"
+
+namespace LLAP {
+
+	VertexLayout& VertexLayout::binding(uint32_t stride, VkVertexInputRate input_rate) {
+		VkVertexInputBindingDescription description{};
+		description.binding = static_cast<uint32_t>(bindings.size());
+		description.stride = stride;
+		description.inputRate = input_rate;
+		bindings.push_back(description);
+
+		return *this;
+	}
+
+	VertexLayout& VertexLayout::attribute(uint32_t location, VkFormat format, uint32_t offset) {
+		if (bindings.empty()) {
+			log("Vertex attribute declared before any binding", ERROR);
+		}
+
+		VkVertexInputAttributeDescription description{};
+		description.location = location;
+		description.binding = bindings.back().binding;
+		description.format = format;
+		description.offset = offset;
+		attributes.push_back(description);
+
+		return *this;
+	}
+
+	const std::vector<VkVertexInputBindingDescription>& VertexLayout::get_bindings() const {
+		return bindings;
+	}
+
+	const std::vector<VkVertexInputAttributeDescription>& VertexLayout::get_attributes() const {
+		return attributes;
+	}
+
+}
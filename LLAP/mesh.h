@@ -0,0 +1,39 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "buffer.h"
+
+namespace LLAP {
+
+	// Vertex input state declared from C++, e.g.
+	// layout.binding(sizeof(Vertex)).attribute(0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, position));
+	class VertexLayout {
+	public:
+		// Starts a new binding, following attributes are read from it
+		VertexLayout& binding(uint32_t stride, VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX);
+		VertexLayout& attribute(uint32_t location, VkFormat format, uint32_t offset);
+
+		const std::vector<VkVertexInputBindingDescription>& get_bindings() const;
+		const std::vector<VkVertexInputAttributeDescription>& get_attributes() const;
+
+	private:
+		std::vector<VkVertexInputBindingDescription> bindings;
+		std::vector<VkVertexInputAttributeDescription> attributes;
+	};
+
+	// Device local vertex and index buffers, indices are 32-bit
+	struct Mesh {
+		Buffer vertices;
+		Buffer indices;
+		uint32_t index_count = 0;
+		// Decode of quantized positions, see MeshData and vertex_decode.glsl
+		float position_offset[3] = { 0.0f, 0.0f, 0.0f };
+		float position_scale[3] = { 1.0f, 1.0f, 1.0f };
+		bool resident = false; // Uploaded and safe to draw
+	};
+
+}
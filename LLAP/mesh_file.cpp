@@ -0,0 +1,157 @@
+#include "mesh_file.h"
+
+#include <cstring>
+#include <fstream>
+
+namespace LLAP {
+
+	static const char MESH_MAGIC[4] = { 'L', 'L', 'M', 'S' };
+	static const uint32_t MESH_VERSION = 2;
+	static const uint64_t STREAM_ALIGNMENT = 16;
+
+	// File layout, all little endian
+	struct MeshFileAttribute {
+		uint32_t location;
+		uint32_t vk_format;
+		uint32_t offset;
+	};
+
+	struct MeshFileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertex_stride;
+		uint32_t attribute_count;
+		uint64_t vertex_count;
+		uint64_t index_count;
+		uint64_t vertex_offset;
+		uint64_t index_offset;
+		MeshFileAttribute attributes[MeshFile::MAX_ATTRIBUTES];
+		float position_offset[3];
+		float position_scale[3];
+	};
+
+	static_assert(sizeof(MeshFileHeader) == 168, "Mesh header must match the file layout");
+
+	static uint64_t align_stream(uint64_t offset) {
+		return (offset + STREAM_ALIGNMENT - 1) / STREAM_ALIGNMENT * STREAM_ALIGNMENT;
+	}
+
+	uint32_t MeshData::vertex_count() const {
+		return vertex_stride > 0 ? static_cast<uint32_t>(vertices.size() / vertex_stride) : 0;
+	}
+
+	MeshFile::MeshFile(const std::string& path) {
+		file = std::make_shared<const MappedFile>(path);
+
+		MeshFileHeader header;
+		if (file->size() < sizeof(header)) {
+			log("Not a mesh file: " + path, ERROR);
+		}
+		std::memcpy(&header, file->data(), sizeof(header));
+
+		if (std::memcmp(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC)) != 0 || header.version != MESH_VERSION) {
+			log("Not a mesh file: " + path, ERROR);
+		}
+		if (header.vertex_stride == 0 || header.attribute_count > MAX_ATTRIBUTES || header.index_count > UINT32_MAX ||
+			header.vertex_offset % STREAM_ALIGNMENT != 0 || header.index_offset % STREAM_ALIGNMENT != 0 ||
+			header.vertex_count > file->size() / header.vertex_stride || header.index_count > file->size() / sizeof(uint32_t) ||
+			header.vertex_offset > file->size() || header.vertex_count * header.vertex_stride > file->size() - header.vertex_offset ||
+			header.index_offset > file->size() || header.index_count * sizeof(uint32_t) > file->size() - header.index_offset)
+		{
+			log("Corrupt mesh header: " + path, ERROR);
+		}
+
+		stride = header.vertex_stride;
+		vertex_offset = header.vertex_offset;
+		vertex_count = header.vertex_count;
+		index_offset = header.index_offset;
+		indices = header.index_count;
+		for (uint32_t i = 0; i < header.attribute_count; i++) {
+			const MeshFileAttribute& attribute = header.attributes[i];
+			attributes.push_back({ attribute.location, static_cast<VkFormat>(attribute.vk_format), attribute.offset });
+		}
+		std::memcpy(offset, header.position_offset, sizeof(offset));
+		std::memcpy(scale, header.position_scale, sizeof(scale));
+	}
+
+	uint32_t MeshFile::vertex_stride() const {
+		return stride;
+	}
+
+	const std::vector<MeshAttribute>& MeshFile::get_attributes() const {
+		return attributes;
+	}
+
+	VertexLayout MeshFile::vertex_layout() const {
+		VertexLayout layout;
+		layout.binding(stride);
+		for (const auto& attribute : attributes) {
+			layout.attribute(attribute.location, attribute.format, attribute.offset);
+		}
+		return layout;
+	}
+
+	const void* MeshFile::vertex_data() const {
+		return file->data() + vertex_offset;
+	}
+
+	VkDeviceSize MeshFile::vertex_size() const {
+		return vertex_count * stride;
+	}
+
+	const uint32_t* MeshFile::index_data() const {
+		return reinterpret_cast<const uint32_t*>(file->data() + index_offset);
+	}
+
+	uint32_t MeshFile::index_count() const {
+		return static_cast<uint32_t>(indices);
+	}
+
+	const float* MeshFile::position_offset() const {
+		return offset;
+	}
+
+	const float* MeshFile::position_scale() const {
+		return scale;
+	}
+
+	void write_mesh(const std::string& path, const MeshData& mesh) {
+		if (mesh.vertex_stride == 0 || mesh.vertices.size() % mesh.vertex_stride != 0 ||
+			mesh.attributes.size() > MeshFile::MAX_ATTRIBUTES)
+		{
+			log("Can't write a mesh whose vertices don't match its stride and attributes", ERROR);
+		}
+
+		MeshFileHeader header{};
+		std::memcpy(header.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+		header.version = MESH_VERSION;
+		header.vertex_stride = mesh.vertex_stride;
+		header.attribute_count = static_cast<uint32_t>(mesh.attributes.size());
+		header.vertex_count = mesh.vertex_count();
+		header.index_count = mesh.indices.size();
+		header.vertex_offset = align_stream(sizeof(header));
+		header.index_offset = align_stream(header.vertex_offset + mesh.vertices.size());
+		for (size_t i = 0; i < mesh.attributes.size(); i++) {
+			header.attributes[i] = { mesh.attributes[i].location, static_cast<uint32_t>(mesh.attributes[i].format), mesh.attributes[i].offset };
+		}
+		std::memcpy(header.position_offset, mesh.position_offset, sizeof(header.position_offset));
+		std::memcpy(header.position_scale, mesh.position_scale, sizeof(header.position_scale));
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			log("Failed to open file", ERROR);
+		}
+
+		const char zeros[STREAM_ALIGNMENT] = {};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(zeros, static_cast<std::streamsize>(header.vertex_offset - sizeof(header)));
+		file.write(mesh.vertices.data(), static_cast<std::streamsize>(mesh.vertices.size()));
+		file.write(zeros, static_cast<std::streamsize>(header.index_offset - header.vertex_offset - mesh.vertices.size()));
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), static_cast<std::streamsize>(sizeof(uint32_t) * mesh.indices.size()));
+
+		if (!file) {
+			log("Failed to write " + path, ERROR);
+		}
+	}
+
+}
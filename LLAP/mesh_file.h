@@ -0,0 +1,73 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "debug.h"
+#include "io.h"
+#include "mesh.h"
+
+namespace LLAP {
+
+	struct MeshAttribute {
+		uint32_t location = 0;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t offset = 0;
+	};
+
+	// One interleaved vertex stream and 32-bit triangle list indices
+	struct MeshData {
+		uint32_t vertex_stride = 0;
+		std::vector<MeshAttribute> attributes;
+		std::vector<char> vertices;
+		std::vector<uint32_t> indices;
+		// Object space position = offset + position * scale, not identity once
+		// positions are quantized against the mesh bounds
+		float position_offset[3] = { 0.0f, 0.0f, 0.0f };
+		float position_scale[3] = { 1.0f, 1.0f, 1.0f };
+
+		uint32_t vertex_count() const;
+	};
+
+	// A .llmesh file, a header followed by the vertex and index streams exactly
+	// as the vertex and index buffers hold them, each 16-byte aligned. Loading
+	// maps the file and copies the streams into staging, nothing is parsed.
+	class MeshFile {
+	public:
+		static const uint32_t MAX_ATTRIBUTES = 8;
+
+		explicit MeshFile(const std::string& path);
+
+		uint32_t vertex_stride() const;
+		const std::vector<MeshAttribute>& get_attributes() const;
+		// The layout to draw the mesh with, a single binding
+		VertexLayout vertex_layout() const;
+
+		const void* vertex_data() const;
+		VkDeviceSize vertex_size() const;
+		const uint32_t* index_data() const;
+		uint32_t index_count() const;
+
+		// See MeshData
+		const float* position_offset() const;
+		const float* position_scale() const;
+
+	private:
+		std::shared_ptr<const MappedFile> file;
+		uint32_t stride = 0;
+		std::vector<MeshAttribute> attributes;
+		uint64_t vertex_offset = 0;
+		uint64_t vertex_count = 0;
+		uint64_t index_offset = 0;
+		uint64_t indices = 0;
+		float offset[3] = {};
+		float scale[3] = {};
+	};
+
+	void write_mesh(const std::string& path, const MeshData& mesh);
+
+}
@@ -0,0 +1,397 @@
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace LLAP {
+
+	static const uint32_t NO_VERTEX = UINT32_MAX;
+	static const uint32_t NO_TRIANGLE = UINT32_MAX;
+
+	// Forsyth's tuning, for a 32 entry LRU cache
+	static const uint32_t SCORE_CACHE_SIZE = 32;
+	static const float CACHE_DECAY_POWER = 1.5f;
+	static const float LAST_TRIANGLE_SCORE = 0.75f;
+	static const float VALENCE_BOOST_SCALE = 2.0f;
+	static const float VALENCE_BOOST_POWER = 0.5f;
+
+	// The cache optimizer is tuned for 32 entries, overdraw clusters are cut for a typical FIFO
+	static const uint32_t OVERDRAW_CACHE_SIZE = 16;
+
+	VertexCacheStats analyze_vertex_cache(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size) {
+		VertexCacheStats stats;
+		if (indices.empty() || vertex_count == 0) {
+			return stats;
+		}
+
+		// A vertex is in the FIFO while fewer than cache_size misses happened since it entered
+		std::vector<uint32_t> timestamps(vertex_count, 0);
+		std::vector<bool> used(vertex_count, false);
+		uint32_t time = cache_size + 1;
+		uint32_t misses = 0;
+		uint32_t unique = 0;
+		for (uint32_t index : indices) {
+			if (time - timestamps[index] > cache_size) {
+				timestamps[index] = time++;
+				misses++;
+			}
+			if (!used[index]) {
+				used[index] = true;
+				unique++;
+			}
+		}
+
+		stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+		stats.atvr = static_cast<float>(misses) / unique;
+		return stats;
+	}
+
+	void deduplicate_vertices(MeshData& mesh) {
+		uint32_t vertex_count = mesh.vertex_count();
+		uint32_t stride = mesh.vertex_stride;
+
+		if (mesh.indices.empty()) {
+			if (vertex_count % 3 != 0) {
+				log("An unindexed mesh needs three vertices per triangle", ERROR);
+			}
+			mesh.indices.resize(vertex_count);
+			for (uint32_t i = 0; i < vertex_count; i++) {
+				mesh.indices[i] = i;
+			}
+		}
+
+		const char* vertices = mesh.vertices.data();
+		auto hash = [&](uint32_t vertex) {
+			// FNV-1a over the vertex' bytes
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(vertices) + static_cast<size_t>(vertex) * stride;
+			size_t value = 2166136261u;
+			for (uint32_t i = 0; i < stride; i++) {
+				value = (value ^ bytes[i]) * 16777619u;
+			}
+			return value;
+		};
+		auto equal = [&](uint32_t a, uint32_t b) {
+			return std::memcmp(vertices + static_cast<size_t>(a) * stride, vertices + static_cast<size_t>(b) * stride, stride) == 0;
+		};
+		std::unordered_map<uint32_t, uint32_t, decltype(hash), decltype(equal)> unique(vertex_count, hash, equal);
+
+		// New vertices in order of first use, unused ones disappear
+		std::vector<uint32_t> remap(vertex_count, NO_VERTEX);
+		std::vector<char> merged;
+		merged.reserve(mesh.vertices.size());
+		for (uint32_t& index : mesh.indices) {
+			if (remap[index] == NO_VERTEX) {
+				auto found = unique.find(index);
+				if (found != unique.end()) {
+					remap[index] = found->second;
+				}
+				else {
+					remap[index] = static_cast<uint32_t>(merged.size() / stride);
+					unique.emplace(index, remap[index]);
+					merged.insert(merged.end(), vertices + static_cast<size_t>(index) * stride, vertices + static_cast<size_t>(index + 1) * stride);
+				}
+			}
+			index = remap[index];
+		}
+
+		mesh.vertices = std::move(merged);
+	}
+
+	static float vertex_score(int32_t cache_position, uint32_t active_triangles) {
+		if (active_triangles == 0) {
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cache_position >= 0) {
+			// The last triangle's vertices get a fixed score, so it isn't simply repeated
+			if (cache_position < 3) {
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else {
+				float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+				score = std::pow(1.0f - (cache_position - 3) * scale, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Vertices with few triangles left are finished first, so they leave the cache for good
+		return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(active_triangles), -VALENCE_BOOST_POWER);
+	}
+
+	void optimize_vertex_cache(MeshData& mesh) {
+		uint32_t vertex_count = mesh.vertex_count();
+		uint32_t triangle_count = static_cast<uint32_t>(mesh.indices.size() / 3);
+		const std::vector<uint32_t>& indices = mesh.indices;
+		if (triangle_count == 0) {
+			return;
+		}
+
+		// Triangles of each vertex, the first active ones of a vertex are the ones not emitted yet
+		std::vector<uint32_t> active(vertex_count, 0);
+		for (uint32_t index : indices) {
+			active[index]++;
+		}
+		std::vector<uint32_t> offsets(vertex_count + 1, 0);
+		for (uint32_t i = 0; i < vertex_count; i++) {
+			offsets[i + 1] = offsets[i] + active[i];
+		}
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+		for (uint32_t i = 0; i < indices.size(); i++) {
+			adjacency[filled[indices[i]]++] = i / 3;
+		}
+
+		std::vector<int32_t> cache_positions(vertex_count, -1);
+		std::vector<float> vertex_scores(vertex_count);
+		for (uint32_t i = 0; i < vertex_count; i++) {
+			vertex_scores[i] = vertex_score(-1, active[i]);
+		}
+
+		std::vector<float> triangle_scores(triangle_count);
+		std::vector<bool> emitted(triangle_count, false);
+		uint32_t best = 0;
+		for (uint32_t i = 0; i < triangle_count; i++) {
+			triangle_scores[i] = vertex_scores[indices[i * 3]] + vertex_scores[indices[i * 3 + 1]] + vertex_scores[indices[i * 3 + 2]];
+			if (triangle_scores[i] > triangle_scores[best]) {
+				best = i;
+			}
+		}
+
+		std::vector<uint32_t> cache;
+		std::vector<uint32_t> next_cache;
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		uint32_t cursor = 0; // Triangles before it are all emitted
+
+		for (uint32_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+			// Nothing in the cache has triangles left, continue with the next unemitted one
+			if (best == NO_TRIANGLE) {
+				while (emitted[cursor]) {
+					cursor++;
+				}
+				best = cursor;
+			}
+
+			const uint32_t* triangle = &indices[best * 3];
+			output.insert(output.end(), triangle, triangle + 3);
+			emitted[best] = true;
+
+			for (uint32_t i = 0; i < 3; i++) {
+				uint32_t vertex = triangle[i];
+				uint32_t* begin = &adjacency[offsets[vertex]];
+				uint32_t* end = begin + active[vertex];
+				*std::find(begin, end, best) = *(end - 1);
+				active[vertex]--;
+			}
+
+			// LRU, the triangle's vertices move to the front. Entries pushed past the end still need new scores.
+			next_cache.assign(triangle, triangle + 3);
+			for (uint32_t vertex : cache) {
+				if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+					next_cache.push_back(vertex);
+				}
+			}
+
+			for (uint32_t i = 0; i < next_cache.size(); i++) {
+				uint32_t vertex = next_cache[i];
+				cache_positions[vertex] = i < SCORE_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+				vertex_scores[vertex] = vertex_score(cache_positions[vertex], active[vertex]);
+			}
+
+			best = NO_TRIANGLE;
+			float best_score = -1.0f;
+			for (uint32_t vertex : next_cache) {
+				for (uint32_t i = 0; i < active[vertex]; i++) {
+					uint32_t candidate = adjacency[offsets[vertex] + i];
+					const uint32_t* corners = &indices[candidate * 3];
+					triangle_scores[candidate] = vertex_scores[corners[0]] + vertex_scores[corners[1]] + vertex_scores[corners[2]];
+					if (triangle_scores[candidate] > best_score) {
+						best_score = triangle_scores[candidate];
+						best = candidate;
+					}
+				}
+			}
+
+			next_cache.resize(std::min<size_t>(next_cache.size(), SCORE_CACHE_SIZE));
+			std::swap(cache, next_cache);
+		}
+
+		mesh.indices = std::move(output);
+	}
+
+	// Misses of triangle in a FIFO cache, see analyze_vertex_cache
+	static uint32_t simulate_triangle(const uint32_t* triangle, std::vector<uint32_t>& timestamps, uint32_t& time) {
+		uint32_t misses = 0;
+		for (uint32_t i = 0; i < 3; i++) {
+			if (time - timestamps[triangle[i]] > OVERDRAW_CACHE_SIZE) {
+				timestamps[triangle[i]] = time++;
+				misses++;
+			}
+		}
+		return misses;
+	}
+
+	void optimize_overdraw(MeshData& mesh, float threshold) {
+		const MeshAttribute* position = nullptr;
+		for (const auto& attribute : mesh.attributes) {
+			if (attribute.location == 0 && attribute.format == VK_FORMAT_R32G32B32_SFLOAT) {
+				position = &attribute;
+			}
+		}
+		uint32_t vertex_count = mesh.vertex_count();
+		uint32_t triangle_count = static_cast<uint32_t>(mesh.indices.size() / 3);
+		if (position == nullptr || triangle_count == 0) {
+			return;
+		}
+
+		auto vertex_position = [&](uint32_t vertex, float* out) {
+			std::memcpy(out, mesh.vertices.data() + static_cast<size_t>(vertex) * mesh.vertex_stride + position->offset, sizeof(float) * 3);
+		};
+
+		// Hard boundaries are where the cache order jumps to triangles sharing nothing with the cache
+		std::vector<uint32_t> timestamps(vertex_count, 0);
+		uint32_t time = OVERDRAW_CACHE_SIZE + 1;
+		std::vector<uint32_t> hard;
+		for (uint32_t i = 0; i < triangle_count; i++) {
+			if (simulate_triangle(&mesh.indices[i * 3], timestamps, time) == 3) {
+				hard.push_back(i);
+			}
+		}
+		hard.push_back(triangle_count);
+		if (hard.front() != 0) {
+			hard.insert(hard.begin(), 0);
+		}
+
+		// Soft boundaries split hard clusters wherever a piece on its own stays within the threshold
+		std::vector<uint32_t> clusters;
+		for (size_t c = 0; c + 1 < hard.size(); c++) {
+			uint32_t start = hard[c];
+			uint32_t end = hard[c + 1];
+
+			time += OVERDRAW_CACHE_SIZE + 1; // Empties the cache
+			uint32_t cluster_misses = 0;
+			for (uint32_t i = start; i < end; i++) {
+				cluster_misses += simulate_triangle(&mesh.indices[i * 3], timestamps, time);
+			}
+			float limit = threshold * cluster_misses / (end - start);
+
+			time += OVERDRAW_CACHE_SIZE + 1;
+			clusters.push_back(start);
+			uint32_t misses = 0;
+			for (uint32_t i = start; i < end; i++) {
+				misses += simulate_triangle(&mesh.indices[i * 3], timestamps, time);
+				uint32_t triangles = i - clusters.back() + 1;
+				if (i + 1 < end && misses <= limit * triangles) {
+					clusters.push_back(i + 1);
+					time += OVERDRAW_CACHE_SIZE + 1;
+					misses = 0;
+				}
+			}
+		}
+		clusters.push_back(triangle_count);
+
+		float center[3] = {};
+		for (uint32_t i = 0; i < vertex_count; i++) {
+			float p[3];
+			vertex_position(i, p);
+			for (int j = 0; j < 3; j++) {
+				center[j] += p[j] / vertex_count;
+			}
+		}
+
+		// Clusters facing away from the center are sorted first, they occlude the rest
+		uint32_t cluster_count = static_cast<uint32_t>(clusters.size() - 1);
+		std::vector<float> sort_keys(cluster_count);
+		for (uint32_t c = 0; c < cluster_count; c++) {
+			float centroid[3] = {};
+			float normal[3] = {};
+			float area_sum = 0.0f;
+			for (uint32_t i = clusters[c]; i < clusters[c + 1]; i++) {
+				float a[3], b[3], d[3];
+				vertex_position(mesh.indices[i * 3], a);
+				vertex_position(mesh.indices[i * 3 + 1], b);
+				vertex_position(mesh.indices[i * 3 + 2], d);
+
+				float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+				float ad[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+				float cross[3] = { ab[1] * ad[2] - ab[2] * ad[1], ab[2] * ad[0] - ab[0] * ad[2], ab[0] * ad[1] - ab[1] * ad[0] };
+				float area = std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+
+				for (int j = 0; j < 3; j++) {
+					centroid[j] += (a[j] + b[j] + d[j]) / 3.0f * area;
+					normal[j] += cross[j];
+				}
+				area_sum += area;
+			}
+
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			float key = 0.0f;
+			if (area_sum > 0.0f && length > 0.0f) {
+				for (int j = 0; j < 3; j++) {
+					key += (centroid[j] / area_sum - center[j]) * normal[j] / length;
+				}
+			}
+			sort_keys[c] = key;
+		}
+
+		std::vector<uint32_t> order(cluster_count);
+		for (uint32_t c = 0; c < cluster_count; c++) {
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return sort_keys[a] > sort_keys[b];
+		});
+
+		std::vector<uint32_t> output;
+		output.reserve(mesh.indices.size());
+		for (uint32_t c : order) {
+			output.insert(output.end(), mesh.indices.begin() + clusters[c] * 3, mesh.indices.begin() + clusters[c + 1] * 3);
+		}
+		mesh.indices = std::move(output);
+	}
+
+	void optimize_vertex_fetch(MeshData& mesh) {
+		uint32_t stride = mesh.vertex_stride;
+		std::vector<uint32_t> remap(mesh.vertex_count(), NO_VERTEX);
+		std::vector<char> vertices;
+		vertices.reserve(mesh.vertices.size());
+
+		for (uint32_t& index : mesh.indices) {
+			if (remap[index] == NO_VERTEX) {
+				remap[index] = static_cast<uint32_t>(vertices.size() / stride);
+				const char* vertex = mesh.vertices.data() + static_cast<size_t>(index) * stride;
+				vertices.insert(vertices.end(), vertex, vertex + stride);
+			}
+			index = remap[index];
+		}
+
+		mesh.vertices = std::move(vertices);
+	}
+
+	MeshOptimizeReport optimize_mesh(MeshData& mesh, float overdraw_threshold) {
+		MeshOptimizeReport report;
+		report.vertices_before = mesh.vertex_count();
+		if (mesh.indices.empty()) {
+			std::vector<uint32_t> sequential(mesh.vertex_count());
+			for (uint32_t i = 0; i < sequential.size(); i++) {
+				sequential[i] = i;
+			}
+			report.before = analyze_vertex_cache(sequential, mesh.vertex_count());
+		}
+		else {
+			report.before = analyze_vertex_cache(mesh.indices, mesh.vertex_count());
+		}
+
+		deduplicate_vertices(mesh);
+		optimize_vertex_cache(mesh);
+		optimize_overdraw(mesh, overdraw_threshold);
+		optimize_vertex_fetch(mesh);
+
+		report.vertices_after = mesh.vertex_count();
+		report.after = analyze_vertex_cache(mesh.indices, mesh.vertex_count());
+		return report;
+	}
+
+}
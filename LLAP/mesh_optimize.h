@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "debug.h"
+#include "mesh_file.h"
+
+namespace LLAP {
+
+	// Post-transform vertex cache efficiency of an index buffer, simulated with a
+	// FIFO cache. ACMR is vertex shader invocations per triangle, 0.5 at best for
+	// large regular meshes and 3 at worst. ATVR is invocations per vertex, 1 at best.
+	struct VertexCacheStats {
+		float acmr = 0.0f;
+		float atvr = 0.0f;
+	};
+
+	VertexCacheStats analyze_vertex_cache(const std::vector<uint32_t>& indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+	// Merges vertices whose bytes are identical and drops unused ones. A mesh
+	// without indices gets them, one triangle per three vertices.
+	void deduplicate_vertices(MeshData& mesh);
+
+	// Reorders triangles so consecutive ones share vertices, after Forsyth's
+	// linear-speed vertex cache optimisation.
+	void optimize_vertex_cache(MeshData& mesh);
+
+	// Reorders clusters of the vertex cache order so triangles facing away from
+	// the mesh' center come first and occlude the ones behind them. Clusters are
+	// cut where the cache order jumps anyway, or where the ACMR stays within
+	// threshold times the original. Needs the position at location 0 as three
+	// floats, other meshes are left alone.
+	void optimize_overdraw(MeshData& mesh, float threshold = 1.05f);
+
+	// Renumbers vertices in the order the indices first use them, so vertex fetch
+	// reads memory mostly front to back
+	void optimize_vertex_fetch(MeshData& mesh);
+
+	struct MeshOptimizeReport {
+		uint32_t vertices_before = 0;
+		uint32_t vertices_after = 0;
+		VertexCacheStats before;
+		VertexCacheStats after;
+	};
+
+	// All of the above in order, for import time or offline conversion
+	MeshOptimizeReport optimize_mesh(MeshData& mesh, float overdraw_threshold = 1.05f);
+
+}
@@ -0,0 +1,287 @@
+#include "mesh_quantize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace LLAP {
+
+	typedef enum ATTRIBUTE_ENCODING {
+		ENCODING_COPY,
+		ENCODING_POSITION,
+		ENCODING_DIRECTION,
+		ENCODING_TANGENT,
+		ENCODING_HALF2,
+		ENCODING_WEIGHTS
+	} ATTRIBUTE_ENCODING;
+
+	static uint32_t format_size(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_R8G8_SNORM:
+			return 2;
+		case VK_FORMAT_R8G8B8A8_SNORM:
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R16G16_SNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_R32_SFLOAT:
+		case VK_FORMAT_R32_UINT:
+		case VK_FORMAT_R32_SINT:
+			return 4;
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_SNORM:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R32G32_SFLOAT:
+		case VK_FORMAT_R32G32_UINT:
+		case VK_FORMAT_R32G32_SINT:
+			return 8;
+		case VK_FORMAT_R32G32B32_SFLOAT:
+		case VK_FORMAT_R32G32B32_UINT:
+		case VK_FORMAT_R32G32B32_SINT:
+			return 12;
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+		case VK_FORMAT_R32G32B32A32_UINT:
+		case VK_FORMAT_R32G32B32A32_SINT:
+			return 16;
+		default:
+			log("Can't quantize a mesh with vertex format " + std::to_string(format), ERROR);
+			return 0;
+		}
+	}
+
+	// Round to nearest even, overflow becomes infinity
+	static uint16_t float_to_half(float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+		uint32_t magnitude = bits & 0x7FFFFFFF;
+
+		if (magnitude >= 0x7F800000) {
+			return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+		}
+		if (magnitude >= 0x477FF000) {
+			return sign | 0x7C00;
+		}
+		if (magnitude < 0x38800000) {
+			// Subnormal, counts of 2^-24
+			return sign | static_cast<uint16_t>(std::nearbyint(std::fabs(value) * 16777216.0f));
+		}
+
+		uint32_t half = (magnitude - 0x38000000) >> 13;
+		uint32_t rest = magnitude & 0x1FFF;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0)) {
+			half++;
+		}
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	static void octahedral_fold(float& x, float& y) {
+		float folded_x = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float folded_y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = folded_x;
+		y = folded_y;
+	}
+
+	static void decode_octahedral(int32_t x, int32_t y, int32_t max, float* direction) {
+		float u = std::max(static_cast<float>(x) / max, -1.0f);
+		float v = std::max(static_cast<float>(y) / max, -1.0f);
+		float z = 1.0f - std::fabs(u) - std::fabs(v);
+		if (z < 0.0f) {
+			octahedral_fold(u, v);
+		}
+		float length = std::sqrt(u * u + v * v + z * z);
+		direction[0] = u / length;
+		direction[1] = v / length;
+		direction[2] = z / length;
+	}
+
+	// Picks whichever neighbouring grid point decodes closest to the direction,
+	// plain rounding is noticeably worse with 8 bits
+	static void encode_octahedral(const float* direction, int32_t max, int32_t* encoded) {
+		float length = std::fabs(direction[0]) + std::fabs(direction[1]) + std::fabs(direction[2]);
+		if (length == 0.0f) {
+			encoded[0] = 0;
+			encoded[1] = 0;
+			return;
+		}
+
+		float x = direction[0] / length;
+		float y = direction[1] / length;
+		if (direction[2] < 0.0f) {
+			octahedral_fold(x, y);
+		}
+
+		float best = -2.0f;
+		int32_t base_x = static_cast<int32_t>(std::floor(x * max));
+		int32_t base_y = static_cast<int32_t>(std::floor(y * max));
+		for (int32_t i = 0; i < 4; i++) {
+			int32_t candidate_x = std::min(base_x + (i & 1), max);
+			int32_t candidate_y = std::min(base_y + (i >> 1), max);
+			float decoded[3];
+			decode_octahedral(candidate_x, candidate_y, max, decoded);
+			float similarity = (decoded[0] * direction[0] + decoded[1] * direction[1] + decoded[2] * direction[2]) / length;
+			if (similarity > best) {
+				best = similarity;
+				encoded[0] = candidate_x;
+				encoded[1] = candidate_y;
+			}
+		}
+	}
+
+	static void store_snorm(int32_t value, uint32_t bits, char* out) {
+		if (bits == 8) {
+			int8_t stored = static_cast<int8_t>(value);
+			std::memcpy(out, &stored, sizeof(stored));
+		}
+		else {
+			int16_t stored = static_cast<int16_t>(value);
+			std::memcpy(out, &stored, sizeof(stored));
+		}
+	}
+
+	void quantize_mesh(MeshData& mesh, const QuantizeSettings& settings) {
+		if (settings.direction_bits != 8 && settings.direction_bits != 16) {
+			log("Octahedral directions take 8 or 16 bits per component", ERROR);
+		}
+		uint32_t direction_bytes = settings.direction_bits / 8;
+		int32_t direction_max = (1 << (settings.direction_bits - 1)) - 1;
+
+		std::vector<ATTRIBUTE_ENCODING> encodings;
+		std::vector<MeshAttribute> attributes;
+		uint32_t stride = 0;
+		for (const auto& attribute : mesh.attributes) {
+			ATTRIBUTE_ENCODING encoding = ENCODING_COPY;
+			VkFormat format = attribute.format;
+			if (attribute.location == settings.position && attribute.format == VK_FORMAT_R32G32B32_SFLOAT) {
+				encoding = ENCODING_POSITION;
+				format = VK_FORMAT_R16G16B16A16_UNORM;
+			}
+			else if (attribute.location == settings.normal && attribute.format == VK_FORMAT_R32G32B32_SFLOAT) {
+				encoding = ENCODING_DIRECTION;
+				format = settings.direction_bits == 8 ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R16G16_SNORM;
+			}
+			else if (attribute.location == settings.tangent && attribute.format == VK_FORMAT_R32G32B32A32_SFLOAT) {
+				encoding = ENCODING_TANGENT;
+				format = settings.direction_bits == 8 ? VK_FORMAT_R8G8B8A8_SNORM : VK_FORMAT_R16G16B16A16_SNORM;
+			}
+			else if (attribute.location == settings.uv && attribute.format == VK_FORMAT_R32G32_SFLOAT) {
+				encoding = ENCODING_HALF2;
+				format = VK_FORMAT_R16G16_SFLOAT;
+			}
+			else if (attribute.location == settings.weights && attribute.format == VK_FORMAT_R32G32B32A32_SFLOAT) {
+				encoding = ENCODING_WEIGHTS;
+				format = VK_FORMAT_R8G8B8A8_UNORM;
+			}
+
+			encodings.push_back(encoding);
+			attributes.push_back({ attribute.location, format, stride });
+			stride += (format_size(format) + 3) / 4 * 4;
+		}
+
+		uint32_t vertex_count = mesh.vertex_count();
+		auto source = [&](uint32_t vertex, size_t attribute, float* out, uint32_t count) {
+			std::memcpy(out, mesh.vertices.data() + static_cast<size_t>(vertex) * mesh.vertex_stride + mesh.attributes[attribute].offset, sizeof(float) * count);
+		};
+
+		// Bounds of the position, a flat axis keeps scale 1 so the decode stays invertible
+		float bounds_min[3] = { 0.0f, 0.0f, 0.0f };
+		float bounds_scale[3] = { 1.0f, 1.0f, 1.0f };
+		for (size_t a = 0; a < attributes.size(); a++) {
+			if (encodings[a] != ENCODING_POSITION || vertex_count == 0) {
+				continue;
+			}
+			float low[3] = { INFINITY, INFINITY, INFINITY };
+			float high[3] = { -INFINITY, -INFINITY, -INFINITY };
+			for (uint32_t v = 0; v < vertex_count; v++) {
+				float position[3];
+				source(v, a, position, 3);
+				for (int i = 0; i < 3; i++) {
+					low[i] = std::min(low[i], position[i]);
+					high[i] = std::max(high[i], position[i]);
+				}
+			}
+			for (int i = 0; i < 3; i++) {
+				bounds_min[i] = low[i];
+				bounds_scale[i] = high[i] > low[i] ? high[i] - low[i] : 1.0f;
+			}
+		}
+
+		std::vector<char> vertices(static_cast<size_t>(stride) * vertex_count, 0);
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			for (size_t a = 0; a < attributes.size(); a++) {
+				char* out = vertices.data() + static_cast<size_t>(v) * stride + attributes[a].offset;
+				float values[4];
+
+				switch (encodings[a]) {
+				case ENCODING_COPY:
+					std::memcpy(out, mesh.vertices.data() + static_cast<size_t>(v) * mesh.vertex_stride + mesh.attributes[a].offset, format_size(attributes[a].format));
+					break;
+				case ENCODING_POSITION:
+					source(v, a, values, 3);
+					for (int i = 0; i < 3; i++) {
+						float normalized = std::min(std::max((values[i] - bounds_min[i]) / bounds_scale[i], 0.0f), 1.0f);
+						uint16_t stored = static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+						std::memcpy(out + i * sizeof(stored), &stored, sizeof(stored));
+					}
+					break;
+				case ENCODING_DIRECTION:
+				case ENCODING_TANGENT: {
+					source(v, a, values, encodings[a] == ENCODING_TANGENT ? 4 : 3);
+					int32_t encoded[2];
+					encode_octahedral(values, direction_max, encoded);
+					store_snorm(encoded[0], settings.direction_bits, out);
+					store_snorm(encoded[1], settings.direction_bits, out + direction_bytes);
+					if (encodings[a] == ENCODING_TANGENT) {
+						store_snorm(values[3] < 0.0f ? -direction_max : direction_max, settings.direction_bits, out + direction_bytes * 3);
+					}
+					break;
+				}
+				case ENCODING_HALF2:
+					source(v, a, values, 2);
+					for (int i = 0; i < 2; i++) {
+						uint16_t stored = float_to_half(values[i]);
+						std::memcpy(out + i * sizeof(stored), &stored, sizeof(stored));
+					}
+					break;
+				case ENCODING_WEIGHTS: {
+					source(v, a, values, 4);
+					float sum = 0.0f;
+					for (int i = 0; i < 4; i++) {
+						values[i] = std::max(values[i], 0.0f);
+						sum += values[i];
+					}
+
+					// Rounding error goes to the largest weight, so they sum to exactly 255
+					int32_t stored[4] = {};
+					int32_t total = 0;
+					int largest = 0;
+					for (int i = 0; i < 4; i++) {
+						stored[i] = sum > 0.0f ? static_cast<int32_t>(std::lround(values[i] / sum * 255.0f)) : (i == 0 ? 255 : 0);
+						total += stored[i];
+						largest = stored[i] > stored[largest] ? i : largest;
+					}
+					stored[largest] += 255 - total;
+					for (int i = 0; i < 4; i++) {
+						out[i] = static_cast<char>(static_cast<uint8_t>(stored[i]));
+					}
+					break;
+				}
+				}
+			}
+		}
+
+		for (size_t a = 0; a < attributes.size(); a++) {
+			if (encodings[a] == ENCODING_POSITION) {
+				// Compose with whatever decode the mesh already had
+				for (int i = 0; i < 3; i++) {
+					mesh.position_offset[i] += bounds_min[i] * mesh.position_scale[i];
+					mesh.position_scale[i] *= bounds_scale[i];
+				}
+			}
+		}
+
+		mesh.vertex_stride = stride;
+		mesh.attributes = std::move(attributes);
+		mesh.vertices = std::move(vertices);
+	}
+
+}
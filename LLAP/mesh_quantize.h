@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "debug.h"
+#include "mesh_file.h"
+
+namespace LLAP {
+
+	// Locations of the attributes quantize_mesh() compresses, NONE for ones the
+	// mesh doesn't have. The defaults are the layout load_obj() produces.
+	struct QuantizeSettings {
+		static const uint32_t NONE = UINT32_MAX;
+
+		uint32_t position = 0;
+		uint32_t normal = 1;
+		uint32_t tangent = NONE;
+		uint32_t uv = 2;
+		uint32_t weights = NONE;
+		// 8 or 16, octahedral normals and tangents take two components of this size
+		uint32_t direction_bits = 8;
+	};
+
+	// Rewrites 32-bit float attributes into compact formats the vertex shader
+	// decodes, see vertex_decode.glsl:
+	// - position, float3: R16G16B16A16_UNORM within the mesh bounds, the decode
+	//   goes into the mesh' position_offset and position_scale
+	// - normal, float3: octahedral R8G8_SNORM or R16G16_SNORM
+	// - tangent, float4 with the bitangent sign in w: octahedral in xy and the
+	//   sign in w of R8G8B8A8_SNORM or R16G16B16A16_SNORM
+	// - uv, float2: R16G16_SFLOAT
+	// - weights, float4: R8G8B8A8_UNORM, still summing to one
+	// Attributes in other formats and at other locations are copied unchanged.
+	// Every attribute starts 4-byte aligned.
+	void quantize_mesh(MeshData& mesh, const QuantizeSettings& settings = QuantizeSettings());
+
+}
@@ -0,0 +1,245 @@
+#include "mips.h"
+
+#include <cstddef>
+#include <algorithm>
+
+namespace LLAP {
+
+	void MipGenerator::init(VkDevice device, Allocator* allocator, const std::vector<char>& shader_code,
+		const std::vector<uint32_t>& families)
+	{
+		this->device = device;
+		this->allocator = allocator;
+		this->families = families;
+
+		VkShaderModuleCreateInfo module_info{};
+		module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		module_info.codeSize = shader_code.size();
+		module_info.pCode = reinterpret_cast<const uint32_t*>(shader_code.data());
+
+		if (vkCreateShaderModule(device, &module_info, host_callbacks(HOST_SCOPE_PIPELINE), &shader) != VK_SUCCESS) {
+			log("Failed to create downsample shader module", ERROR);
+		}
+
+		// Level 0 is read with texelFetch, the sampler is never used to filter
+		VkSamplerCreateInfo sampler_info{};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_NEAREST;
+		sampler_info.minFilter = VK_FILTER_NEAREST;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+		if (vkCreateSampler(device, &sampler_info, host_callbacks(HOST_SCOPE_DEVICE), &sampler) != VK_SUCCESS) {
+			log("Failed to create downsample sampler", ERROR);
+		}
+
+		layout.binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT,
+			offsetof(DescriptorData, source));
+		layout.binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT,
+			offsetof(DescriptorData, levels), MAX_LEVELS - 1);
+		layout.binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT,
+			offsetof(DescriptorData, scratch));
+		layout.create(device);
+		pool.init(device, 16);
+
+		VkPushConstantRange push_constants{};
+		push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push_constants.offset = 0;
+		push_constants.size = sizeof(Constants);
+
+		VkDescriptorSetLayout set_layout = layout.get_layout();
+		VkPipelineLayoutCreateInfo pipeline_layout_info{};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.setLayoutCount = 1;
+		pipeline_layout_info.pSetLayouts = &set_layout;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constants;
+
+		if (vkCreatePipelineLayout(device, &pipeline_layout_info, host_callbacks(HOST_SCOPE_PIPELINE), &pipeline_layout) != VK_SUCCESS) {
+			log("Failed to create downsample pipeline layout", ERROR);
+		}
+
+		// One pipeline per filter, the shader branches on a specialization constant
+		for (uint32_t filter = 0; filter < MIP_FILTER_COUNT; filter++) {
+			VkSpecializationMapEntry entry{};
+			entry.constantID = 0;
+			entry.offset = 0;
+			entry.size = sizeof(uint32_t);
+
+			VkSpecializationInfo specialization{};
+			specialization.mapEntryCount = 1;
+			specialization.pMapEntries = &entry;
+			specialization.dataSize = sizeof(uint32_t);
+			specialization.pData = &filter;
+
+			VkComputePipelineCreateInfo pipeline_info{};
+			pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			pipeline_info.stage.module = shader;
+			pipeline_info.stage.pName = "main";
+			pipeline_info.stage.pSpecializationInfo = &specialization;
+			pipeline_info.layout = pipeline_layout;
+
+			if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, host_callbacks(HOST_SCOPE_PIPELINE), &pipelines[filter]) != VK_SUCCESS) {
+				log("Failed to create downsample pipeline", ERROR);
+			}
+		}
+	}
+
+	void MipGenerator::cleanup() {
+		for (auto& pipeline : pipelines) {
+			vkDestroyPipeline(device, pipeline, host_callbacks(HOST_SCOPE_PIPELINE));
+			pipeline = VK_NULL_HANDLE;
+		}
+		vkDestroyPipelineLayout(device, pipeline_layout, host_callbacks(HOST_SCOPE_PIPELINE));
+		pool.cleanup();
+		layout.destroy(device);
+		vkDestroySampler(device, sampler, host_callbacks(HOST_SCOPE_DEVICE));
+		vkDestroyShaderModule(device, shader, host_callbacks(HOST_SCOPE_PIPELINE));
+		pipeline_layout = VK_NULL_HANDLE;
+		sampler = VK_NULL_HANDLE;
+		shader = VK_NULL_HANDLE;
+	}
+
+	MipTarget MipGenerator::create_target(const Image& image) {
+		if (image.layers > 1) {
+			log("Mip generation only handles single layer images", ERROR);
+		}
+		if (image.mip_levels > MAX_LEVELS || image.extent.width > (1u << (MAX_LEVELS - 1)) ||
+			image.extent.height > (1u << (MAX_LEVELS - 1)))
+		{
+			log("Mip generation is limited to 4096x4096 images", ERROR);
+		}
+
+		MipTarget target;
+		if (image.mip_levels < 2) {
+			return target;
+		}
+
+		for (uint32_t level = 0; level < image.mip_levels; level++) {
+			VkImageViewCreateInfo view_info{};
+			view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			view_info.image = image.image;
+			view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view_info.format = image.format;
+			view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			view_info.subresourceRange.baseMipLevel = level;
+			view_info.subresourceRange.levelCount = 1;
+			view_info.subresourceRange.baseArrayLayer = 0;
+			view_info.subresourceRange.layerCount = 1;
+
+			VkImageView view;
+			if (vkCreateImageView(device, &view_info, host_callbacks(HOST_SCOPE_DEVICE), &view) != VK_SUCCESS) {
+				log("Failed to create mip level view", ERROR);
+			}
+			target.views.push_back(view);
+		}
+
+		target.scratch = create_buffer(device, *allocator, SCRATCH_SIZE,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_RENDER_TARGET, families);
+
+		// Slots past the last level repeat it, the shader never writes them
+		DescriptorData data{};
+		data.source = { sampler, target.views[0], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		for (uint32_t i = 0; i < MAX_LEVELS - 1; i++) {
+			uint32_t level = std::min(i + 1, image.mip_levels - 1);
+			data.levels[i] = { VK_NULL_HANDLE, target.views[level], VK_IMAGE_LAYOUT_GENERAL };
+		}
+		data.scratch = { target.scratch.buffer, 0, SCRATCH_SIZE };
+
+		target.set = pool.allocate(layout.get_layout());
+		layout.update(device, target.set, &data);
+
+		return target;
+	}
+
+	void MipGenerator::destroy_target(MipTarget& target) {
+		for (auto view : target.views) {
+			vkDestroyImageView(device, view, host_callbacks(HOST_SCOPE_DEVICE));
+		}
+		if (target.scratch.buffer != VK_NULL_HANDLE) {
+			destroy_buffer(device, *allocator, target.scratch);
+		}
+		target = MipTarget{};
+	}
+
+	void MipGenerator::generate(VkCommandBuffer command_buffer, const Image& image, MipTarget& target, MIP_FILTER filter,
+		VkImageLayout layout)
+	{
+		if (target.set == VK_NULL_HANDLE) {
+			return;
+		}
+
+		// The shader resets the counter after every dispatch, it only starts at zero once
+		bool clear = !target.cleared;
+		if (clear) {
+			vkCmdFillBuffer(command_buffer, target.scratch.buffer, 0, sizeof(uint32_t), 0);
+			target.cleared = true;
+		}
+
+		VkImageMemoryBarrier barriers[2]{};
+		for (auto& barrier : barriers) {
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = image.image;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = 1;
+		}
+
+		// Level 0 after whatever wrote it, the rest are overwritten entirely
+		barriers[0].srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers[0].oldLayout = layout;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[0].subresourceRange.baseMipLevel = 0;
+		barriers[0].subresourceRange.levelCount = 1;
+
+		barriers[1].srcAccessMask = 0;
+		barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[1].subresourceRange.baseMipLevel = 1;
+		barriers[1].subresourceRange.levelCount = image.mip_levels - 1;
+
+		// After the clear, or the previous dispatch's counter reset
+		VkBufferMemoryBarrier scratch_barrier{};
+		scratch_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		scratch_barrier.srcAccessMask = clear ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_WRITE_BIT;
+		scratch_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		scratch_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		scratch_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		scratch_barrier.buffer = target.scratch.buffer;
+		scratch_barrier.offset = 0;
+		scratch_barrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 1, &scratch_barrier, 2, barriers);
+
+		uint32_t groups_x = (image.extent.width + TILE_SIZE - 1) / TILE_SIZE;
+		uint32_t groups_y = (image.extent.height + TILE_SIZE - 1) / TILE_SIZE;
+
+		Constants constants;
+		constants.level_count = image.mip_levels - 1;
+		constants.workgroup_count = groups_x * groups_y;
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[filter]);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &target.set, 0, nullptr);
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Constants), &constants);
+		vkCmdDispatch(command_buffer, groups_x, groups_y, 1);
+
+		barriers[1].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barriers[1]);
+	}
+
+}
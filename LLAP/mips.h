@@ -0,0 +1,82 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+#include "debug.h"
+#include "allocator.h"
+#include "buffer.h"
+#include "image.h"
+#include "descriptors.h"
+
+namespace LLAP {
+
+	typedef enum MIP_FILTER {
+		MIP_FILTER_BOX,
+		MIP_FILTER_KAISER, // Sharper first level, the rest are box filtered
+		MIP_FILTER_MIN, // Depth pyramids for occlusion culling
+		MIP_FILTER_MAX,
+		MIP_FILTER_COUNT,
+	} MIP_FILTER;
+
+	// Views and descriptors that generate one image's levels, kept as long as the image
+	struct MipTarget {
+		std::vector<VkImageView> views; // views[0] samples level 0, views[i] writes level i
+		Buffer scratch; // Workgroup counter and level 6 of every workgroup
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		bool cleared = false;
+	};
+
+	// Generates a whole mip chain in one compute dispatch (downsample.comp) with
+	// two pipeline barriers, rather than a blit and a barrier per level. Needs
+	// shaderStorageImageWriteWithoutFormat.
+	class MipGenerator {
+	public:
+		// A 4096x4096 level 0 and the 12 levels below it
+		static const uint32_t MAX_LEVELS = 13;
+
+		// families are the queue families generate() records for
+		void init(VkDevice device, Allocator* allocator, const std::vector<char>& shader_code,
+			const std::vector<uint32_t>& families);
+		void cleanup();
+
+		// image needs SAMPLED and STORAGE usage, so sRGB formats are out. Descriptor
+		// sets of destroyed targets are only reclaimed by cleanup().
+		MipTarget create_target(const Image& image);
+		void destroy_target(MipTarget& target);
+
+		// Fills levels 1 and up of image from level 0, which is in layout and may have
+		// been written by any earlier command. Every level ends up in SHADER_READ_ONLY_OPTIMAL.
+		void generate(VkCommandBuffer command_buffer, const Image& image, MipTarget& target, MIP_FILTER filter,
+			VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	private:
+		static const uint32_t TILE_SIZE = 64; // Level 0 texels per workgroup and axis
+		static const VkDeviceSize SCRATCH_SIZE = 16 + 64 * 64 * 16; // std430 Scratch block
+
+		struct Constants {
+			uint32_t level_count;
+			uint32_t workgroup_count;
+		};
+
+		struct DescriptorData {
+			VkDescriptorImageInfo source;
+			VkDescriptorImageInfo levels[MAX_LEVELS - 1];
+			VkDescriptorBufferInfo scratch;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		Allocator* allocator = nullptr;
+		std::vector<uint32_t> families;
+
+		VkShaderModule shader = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		DescriptorLayout layout;
+		DescriptorPool pool;
+		VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+		VkPipeline pipelines[MIP_FILTER_COUNT] = {};
+	};
+
+}
@@ -0,0 +1,193 @@
+#include "obj.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "io.h"
+
+namespace LLAP {
+
+	struct ObjVertex {
+		float position[3];
+		float normal[3];
+		float uv[2];
+	};
+
+	// Indices of one face corner, 0 when missing
+	struct ObjCorner {
+		int32_t position;
+		int32_t uv;
+		int32_t normal;
+
+		bool operator==(const ObjCorner& other) const {
+			return position == other.position && uv == other.uv && normal == other.normal;
+		}
+	};
+
+	struct ObjCornerHash {
+		size_t operator()(const ObjCorner& corner) const {
+			size_t hash = static_cast<uint32_t>(corner.position);
+			hash = hash * 31 + static_cast<uint32_t>(corner.uv);
+			return hash * 31 + static_cast<uint32_t>(corner.normal);
+		}
+	};
+
+	// OBJ indices start at 1, negative ones count back from the last element
+	static int32_t resolve_index(long index, size_t count) {
+		if (index < 0) {
+			index += static_cast<long>(count) + 1;
+		}
+		if (index <= 0 || static_cast<size_t>(index) > count) {
+			log("OBJ index out of range", ERROR);
+		}
+		return static_cast<int32_t>(index);
+	}
+
+	MeshData load_obj(const std::string& path) {
+		std::vector<char> text = read_file(path);
+		text.push_back('\0');
+
+		std::vector<float> positions;
+		std::vector<float> uvs;
+		std::vector<float> normals;
+		std::vector<ObjVertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<bool> derived; // Vertices whose normal is averaged from faces
+		std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> corners;
+		std::vector<uint32_t> face;
+
+		const char* cursor = text.data();
+		while (*cursor != '\0') {
+			const char* line = cursor;
+			const char* end = std::strchr(line, '\n');
+			cursor = end != nullptr ? end + 1 : line + std::strlen(line);
+
+			while (*line == ' ' || *line == '\t') {
+				line++;
+			}
+
+			char* next = nullptr;
+			if (line[0] == 'v' && (line[1] == ' ' || line[1] == '\t')) {
+				const char* value = line + 1;
+				for (int i = 0; i < 3; i++) {
+					positions.push_back(std::strtof(value, &next));
+					value = next;
+				}
+			}
+			else if (line[0] == 'v' && line[1] == 't') {
+				const char* value = line + 2;
+				float u = std::strtof(value, &next);
+				float v = std::strtof(next, &next);
+				// OBJ puts v = 0 at the bottom, Vulkan samples from the top
+				uvs.push_back(u);
+				uvs.push_back(1.0f - v);
+			}
+			else if (line[0] == 'v' && line[1] == 'n') {
+				const char* value = line + 2;
+				for (int i = 0; i < 3; i++) {
+					normals.push_back(std::strtof(value, &next));
+					value = next;
+				}
+			}
+			else if (line[0] == 'f' && (line[1] == ' ' || line[1] == '\t')) {
+				face.clear();
+				const char* value = line + 1;
+				while (true) {
+					long position = std::strtol(value, &next, 10);
+					if (next == value) {
+						break;
+					}
+
+					ObjCorner corner = { resolve_index(position, positions.size() / 3), 0, 0 };
+					value = next;
+					if (*value == '/') {
+						value++;
+						if (*value != '/') {
+							corner.uv = resolve_index(std::strtol(value, &next, 10), uvs.size() / 2);
+							value = next;
+						}
+						if (*value == '/') {
+							value++;
+							corner.normal = resolve_index(std::strtol(value, &next, 10), normals.size() / 3);
+							value = next;
+						}
+					}
+
+					auto found = corners.find(corner);
+					if (found == corners.end()) {
+						ObjVertex vertex{};
+						std::memcpy(vertex.position, &positions[(corner.position - 1) * 3], sizeof(vertex.position));
+						if (corner.uv != 0) {
+							std::memcpy(vertex.uv, &uvs[(corner.uv - 1) * 2], sizeof(vertex.uv));
+						}
+						if (corner.normal != 0) {
+							std::memcpy(vertex.normal, &normals[(corner.normal - 1) * 3], sizeof(vertex.normal));
+						}
+						found = corners.emplace(corner, static_cast<uint32_t>(vertices.size())).first;
+						vertices.push_back(vertex);
+						derived.push_back(corner.normal == 0);
+					}
+					face.push_back(found->second);
+				}
+
+				if (face.size() < 3) {
+					log("OBJ face with fewer than three corners in " + path, ERROR);
+				}
+
+				// Area weighted face normal, added to corners that have none of their own
+				const float* a = vertices[face[0]].position;
+				float normal[3] = {};
+				for (size_t i = 1; i + 1 < face.size(); i++) {
+					const float* b = vertices[face[i]].position;
+					const float* c = vertices[face[i + 1]].position;
+					float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+					float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+					normal[0] += ab[1] * ac[2] - ab[2] * ac[1];
+					normal[1] += ab[2] * ac[0] - ab[0] * ac[2];
+					normal[2] += ab[0] * ac[1] - ab[1] * ac[0];
+
+					indices.push_back(face[0]);
+					indices.push_back(face[i]);
+					indices.push_back(face[i + 1]);
+				}
+				for (uint32_t index : face) {
+					if (derived[index]) {
+						for (int i = 0; i < 3; i++) {
+							vertices[index].normal[i] += normal[i];
+						}
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < vertices.size(); i++) {
+			if (!derived[i]) {
+				continue;
+			}
+			float* normal = vertices[i].normal;
+			float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+			if (length > 0.0f) {
+				for (int j = 0; j < 3; j++) {
+					normal[j] /= length;
+				}
+			}
+		}
+
+		MeshData mesh;
+		mesh.vertex_stride = sizeof(ObjVertex);
+		mesh.attributes = {
+			{ 0, VK_FORMAT_R32G32B32_SFLOAT, static_cast<uint32_t>(offsetof(ObjVertex, position)) },
+			{ 1, VK_FORMAT_R32G32B32_SFLOAT, static_cast<uint32_t>(offsetof(ObjVertex, normal)) },
+			{ 2, VK_FORMAT_R32G32_SFLOAT, static_cast<uint32_t>(offsetof(ObjVertex, uv)) },
+		};
+		mesh.vertices.resize(sizeof(ObjVertex) * vertices.size());
+		std::memcpy(mesh.vertices.data(), vertices.data(), mesh.vertices.size());
+		mesh.indices = std::move(indices);
+		return mesh;
+	}
+
+}
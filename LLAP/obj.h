@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+#include "debug.h"
+#include "mesh_file.h"
+
+namespace LLAP {
+
+	// Converts a Wavefront OBJ to a triangle list with position, normal and
+	// texture coordinate at locations 0, 1 and 2, all 32-bit floats. Polygons are
+	// fanned and corners sharing all their indices become one vertex. Corners
+	// without a normal get the average of their faces' normals. Materials and
+	// groups are ignored, the whole file is one mesh.
+	MeshData load_obj(const std::string& path);
+
+}
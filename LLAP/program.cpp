@@ -1,5 +1,10 @@
 #include "program.h"
 
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
 namespace LLAP {
 
 	void Program::init_window() {
@@ -147,37 +152,12 @@ namespace LLAP {
 			framebuffer_info.height = swap_chain_extent.height;
 			framebuffer_info.layers = 1;
 
-			if (vkCreateFramebuffer(device, &framebuffer_info, nullptr, &swap_chain_framebuffers[i]) != VK_SUCCESS) {
+			if (vkCreateFramebuffer(device, &framebuffer_info, host_callbacks(HOST_SCOPE_DEVICE), &swap_chain_framebuffers[i]) != VK_SUCCESS) {
 				log("Failed to create framebuffer", ERROR);
 			}
 		}
 	}
 
-	SwapChainSupportDetails Program::query_swap_chain_support(VkPhysicalDevice device)
-	{
-		SwapChainSupportDetails details;
-
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-		uint32_t format_count;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, nullptr);
-
-		if (format_count > 0) {
-			details.formats.resize(format_count);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, details.formats.data());
-		}
-
-		uint32_t present_mode_count;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, nullptr);
-
-		if (present_mode_count > 0) {
-			details.present_modes.resize(present_mode_count);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, details.present_modes.data());
-		}
-		
-		return details;
-	}
-
 	VkSurfaceFormatKHR Program::choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats)
 	{
 		for (const auto& format : available_formats) {
@@ -221,7 +201,7 @@ namespace LLAP {
 	}
 
 	void Program::create_swap_chain() {
-		SwapChainSupportDetails swap_chain_support = query_swap_chain_support(physical_device);
+		const SwapChainSupportDetails& swap_chain_support = gpu.swap_chain_support;
 
 		VkSurfaceFormatKHR surface_format = choose_swap_surface_format(swap_chain_support.formats);
 		VkPresentModeKHR present_mode = choose_swap_present_mode(swap_chain_support.present_modes);
@@ -245,7 +225,7 @@ namespace LLAP {
 		create_info.imageArrayLayers = 1;
 		create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-		QueueFamilyIndices indices = find_queue_families(physical_device);
+		const QueueFamilyIndices& indices = gpu.indices;
 		uint32_t queue_family_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
 
 		if (indices.graphics_family != indices.present_family) {
@@ -265,7 +245,7 @@ namespace LLAP {
 		create_info.clipped = VK_TRUE;
 		create_info.oldSwapchain = VK_NULL_HANDLE;
 
-		if (vkCreateSwapchainKHR(device, &create_info, nullptr, &swap_chain) != VK_SUCCESS) {
+		if (vkCreateSwapchainKHR(device, &create_info, host_callbacks(HOST_SCOPE_DEVICE), &swap_chain) != VK_SUCCESS) {
 			log("Failed to create swap chain", ERROR);
 		}
 		else {
@@ -299,28 +279,23 @@ namespace LLAP {
 			create_info.subresourceRange.baseArrayLayer = 0;
 			create_info.subresourceRange.layerCount = 1;
 
-			if (vkCreateImageView(device, &create_info, nullptr, &swap_chain_image_views[i]) != VK_SUCCESS) {
+			if (vkCreateImageView(device, &create_info, host_callbacks(HOST_SCOPE_DEVICE), &swap_chain_image_views[i]) != VK_SUCCESS) {
 				log("Failed to create image views", ERROR);
 			}
 		}
 	}
 
-	bool Program::check_device_extension_support(VkPhysicalDevice device) {
-		uint32_t extension_count;
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
-
-		std::vector<VkExtensionProperties> available_extensions(extension_count);
-		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
-		
-		std::set<std::string> required_extensions(device_extensions.begin(), device_extensions.end());
-		for (const auto& extension : available_extensions) {
-			required_extensions.erase(extension.extensionName);
+	bool Program::check_device_extension_support(const DeviceSnapshot& snapshot) {
+		for (const auto& extension : device_extensions) {
+			if (!snapshot.has_extension(extension)) {
+				return false;
+			}
 		}
-		return required_extensions.empty();
+		return true;
 	}
 
 	void Program::create_surface() {
-		if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
+		if (glfwCreateWindowSurface(instance, window, host_callbacks(HOST_SCOPE_INSTANCE), &surface) != VK_SUCCESS) {
 			log("Couldn't create window surface", ERROR);
 		}
 	}
@@ -337,12 +312,59 @@ namespace LLAP {
 		std::vector<VkPhysicalDevice> devices(device_count);
 		vkEnumeratePhysicalDevices(instance, &device_count, devices.data());
 
+		// Environment variables take precedence over settings made by the subclass
+		const char* gpu_env = std::getenv("LLAP_GPU");
+		std::string selection = gpu_env != nullptr ? gpu_env : preferred_gpu;
+		const char* cache_env = std::getenv("LLAP_DEVICE_CACHE");
+		std::string cache_directory = cache_env != nullptr ? cache_env : device_cache_directory;
+
 		log("Querying devices for suitable GPU:");
-		for (const auto& device : devices) {
-			if (is_gpu_suitable(device)) {
-				physical_device = device;
-				break;
+		std::vector<DeviceSnapshot> snapshots;
+		std::vector<uint32_t> device_indices;
+		size_t best = 0;
+		int64_t best_score = -1;
+		for (uint32_t i = 0; i < device_count; i++) {
+			DeviceSnapshot snapshot = build_snapshot(devices[i], surface, cache_directory);
+			int64_t score = rate_gpu(snapshot);
+			if (score < 0) {
+				continue;
+			}
+
+			if (score > best_score) {
+				best_score = score;
+				best = snapshots.size();
 			}
+			snapshots.push_back(std::move(snapshot));
+			device_indices.push_back(i);
+		}
+
+		// A selection of digits is only ever a device index, anything else matches
+		// names, an exact match before the first containing it
+		size_t selected = snapshots.size();
+		if (!selection.empty()) {
+			bool is_index = std::all_of(selection.begin(), selection.end(), [](char c) { return c >= '0' && c <= '9'; });
+			for (size_t i = 0; i < snapshots.size() && selected == snapshots.size(); i++) {
+				if (is_index ? selection == std::to_string(device_indices[i]) : selection == snapshots[i].properties.deviceName) {
+					selected = i;
+				}
+			}
+			for (size_t i = 0; i < snapshots.size() && selected == snapshots.size() && !is_index; i++) {
+				if (std::string(snapshots[i].properties.deviceName).find(selection) != std::string::npos) {
+					selected = i;
+				}
+			}
+
+			if (selected < snapshots.size()) {
+				log("Device [" + std::string(snapshots[selected].properties.deviceName) + "] selected by override \"" + selection + "\"");
+			}
+			else {
+				log("No suitable GPU matches override \"" + selection + "\", using the highest score", WARNING);
+			}
+		}
+
+		if (!snapshots.empty()) {
+			gpu = std::move(snapshots[selected < snapshots.size() ? selected : best]);
+			physical_device = gpu.device;
 		}
 
 		if (physical_device == VK_NULL_HANDLE) {
@@ -350,58 +372,136 @@ namespace LLAP {
 		}
 	}
 
-	bool Program::is_gpu_suitable(VkPhysicalDevice device) {
-		VkPhysicalDeviceProperties device_properties;
-		VkPhysicalDeviceFeatures device_features;
-		vkGetPhysicalDeviceProperties(device, &device_properties);
-		vkGetPhysicalDeviceFeatures(device, &device_features);
+	bool Program::is_gpu_suitable(const DeviceSnapshot& snapshot) {
+		const VkPhysicalDeviceProperties& device_properties = snapshot.properties;
 
 		std::cout << device_properties.deviceName << "\n";
 
-		bool extensions_supported = check_device_extension_support(device);
-		QueueFamilyIndices indices = find_queue_families(device);
+		// Memory requirements and descriptor update templates are core in 1.1
+		bool api_supported = device_properties.apiVersion >= VK_API_VERSION_1_1;
+		bool extensions_supported = check_device_extension_support(snapshot);
+		const QueueFamilyIndices& indices = snapshot.indices;
 
 		bool swap_chain_adequate = false;
 		if (extensions_supported) {
-			SwapChainSupportDetails swap_chain_support = query_swap_chain_support(device);
+			const SwapChainSupportDetails& swap_chain_support = snapshot.swap_chain_support;
 			swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
 		}
 
-		if (indices.graphics_family.has_value() && extensions_supported && swap_chain_adequate) {
+		if (indices.graphics_family.has_value() && indices.present_family.has_value() &&
+			api_supported && extensions_supported && swap_chain_adequate)
+		{
 			log("Device [" + static_cast<std::string>(device_properties.deviceName) + "] is suitable");
 			return true;
 		}
+
+		return false;
+	}
+
+	int64_t Program::rate_gpu(const DeviceSnapshot& snapshot) {
+		if (!is_gpu_suitable(snapshot)) {
+			return -1;
+		}
+
+		const VkPhysicalDeviceProperties& device_properties = snapshot.properties;
+		const VkPhysicalDeviceFeatures& device_features = snapshot.features;
+		const VkPhysicalDeviceMemoryProperties& memory_properties = snapshot.memory_properties;
+
+		// Device type dominates, everything else only breaks ties within a type
+		int64_t score = 0;
+		switch (device_properties.deviceType) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			score += 4000000;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			score += 3000000;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			score += 2000000;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:
+			score += 1000000;
+			break;
+		default:
+			break;
+		}
+
+		// Largest device local heap in MiB, capped so it can't outweigh the device type
+		VkDeviceSize local_heap = 0;
+		for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+			if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+				local_heap = std::max(local_heap, memory_properties.memoryHeaps[i].size);
+			}
+		}
+		score += static_cast<int64_t>(std::min<VkDeviceSize>(local_heap >> 20, 65536)) * 10;
+
+		// Queue topology
+		const QueueFamilyIndices& indices = snapshot.indices;
+		if (indices.compute_family != indices.graphics_family) {
+			score += 50000;
+		}
+		if (indices.transfer_family != indices.compute_family) {
+			score += 50000;
+		}
+		if (indices.present_family == indices.graphics_family) {
+			score += 10000;
+		}
+
+		// Features the fast paths can use
+		for (VkBool32 feature : {
+			device_features.multiDrawIndirect,
+			device_features.drawIndirectFirstInstance,
+			device_features.shaderInt16,
+			device_features.textureCompressionBC,
+			device_features.textureCompressionETC2,
+			device_features.textureCompressionASTC_LDR,
+			device_features.samplerAnisotropy })
+		{
+			if (feature) {
+				score += 10000;
+			}
+		}
+
+		log("Device [" + static_cast<std::string>(device_properties.deviceName) + "] score: " + std::to_string(score));
+
+		return score;
 	}
 
 	void Program::create_logical_device() {
-		QueueFamilyIndices indices = find_queue_families(physical_device);
+		const QueueFamilyIndices& indices = gpu.indices;
 		
 		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 		std::set<uint32_t> unique_queue_families = { 
 			indices.graphics_family.value(),
-			indices.present_family.value()
+			indices.present_family.value(),
+			indices.compute_family.value(),
+			indices.transfer_family.value()
 		};
 
 		float queue_priority = 1.0f;
 		for (uint32_t queue_family : unique_queue_families) {
 			VkDeviceQueueCreateInfo queue_create_info{};
 			queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-			queue_create_info.queueFamilyIndex = indices.graphics_family.value();
+			queue_create_info.queueFamilyIndex = queue_family;
 			queue_create_info.queueCount = 1;
 			queue_create_info.pQueuePriorities = &queue_priority;
 			queue_create_infos.push_back(queue_create_info);
 		}
 
-		VkPhysicalDeviceFeatures device_features{};
+		// Required extensions plus whichever optional ones negotiation enables
+		FeatureChain enabled_features;
+		std::vector<const char*> extensions(device_extensions.begin(), device_extensions.end());
+		capabilities = negotiate_capabilities(gpu, enabled_features, extensions);
 
 		VkDeviceCreateInfo create_info{};
 		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		create_info.pNext = &enabled_features.features;
 		create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
 		create_info.pQueueCreateInfos = queue_create_infos.data();
-		create_info.pEnabledFeatures = &device_features;
+		create_info.pEnabledFeatures = nullptr;
 
-		create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
-		create_info.ppEnabledExtensionNames = device_extensions.data();
+		create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+		create_info.ppEnabledExtensionNames = extensions.data();
 
 		if (enable_validation_layers) {
 			create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size());
@@ -411,62 +511,68 @@ namespace LLAP {
 			create_info.enabledLayerCount = 0;
 		}
 
-		if (vkCreateDevice(physical_device, &create_info, nullptr, &device) != VK_SUCCESS) {
+		if (vkCreateDevice(physical_device, &create_info, host_callbacks(HOST_SCOPE_DEVICE), &device) != VK_SUCCESS) {
 			log("Failed to create a logical device", ERROR);
 		}
 
 		log("Created logical device");
 
-		vkGetDeviceQueue(device, indices.graphics_family.value(), 0, &graphics_queue);
+		// Queues sharing a family share the one VkQueue created for it
+		graphics_queue.family = indices.graphics_family.value();
+		compute_queue.family = indices.compute_family.value();
+		transfer_queue.family = indices.transfer_family.value();
+		vkGetDeviceQueue(device, graphics_queue.family, 0, &graphics_queue.queue);
+		vkGetDeviceQueue(device, compute_queue.family, 0, &compute_queue.queue);
+		vkGetDeviceQueue(device, transfer_queue.family, 0, &transfer_queue.queue);
 		vkGetDeviceQueue(device, indices.present_family.value(), 0, &present_queue);
-	}
-
-	QueueFamilyIndices Program::find_queue_families(VkPhysicalDevice device) {
-		QueueFamilyIndices indices;
-		
-		uint32_t queue_family_count = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
 
-		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families.data());
+		log("Queue families: graphics " + std::to_string(graphics_queue.family) +
+			", compute " + std::to_string(compute_queue.family) +
+			", transfer " + std::to_string(transfer_queue.family) +
+			", present " + std::to_string(indices.present_family.value()));
 
-		int i = 0;
-		for (const auto& queue_family : queue_families) {
-			if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				indices.graphics_family = i;
-
-				VkBool32 present_support = false;
-				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-				if (present_support) {
-					indices.present_family = i;
-				}
-			}
+		load_timeline_functions();
+		allocator.init(device, gpu, capabilities.memory_budget);
+		defragmenter.init(device, &allocator);
+		ring.init(device, &allocator, gpu, frame_ring_size, MAX_FRAMES_IN_FLIGHT);
+		arena.init(frame_arena_size, MAX_FRAMES_IN_FLIGHT, frame_arena_huge_pages);
+	}
 
-			i++;
+	Queue& Program::get_queue(QUEUE_TYPE type) {
+		switch (type) {
+		case QUEUE_COMPUTE:
+			return compute_queue;
+		case QUEUE_TRANSFER:
+			return transfer_queue;
+		case QUEUE_GRAPHICS:
+		default:
+			return graphics_queue;
 		}
-
-		return indices;
 	}
 
 	void Program::create_command_pool() {
-		QueueFamilyIndices queue_family_indices = find_queue_families(physical_device);
-
-		VkCommandPoolCreateInfo pool_info{};
-		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
-		pool_info.flags = 0;
-
-		if (vkCreateCommandPool(device, &pool_info, nullptr, &command_pool) != VK_SUCCESS) {
-			log("Failed to create command pool", ERROR);
+		for (Queue* queue : { &graphics_queue, &compute_queue, &transfer_queue }) {
+			VkCommandPoolCreateInfo pool_info{};
+			pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+			pool_info.queueFamilyIndex = queue->family;
+			pool_info.flags = queue == &graphics_queue ? VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT :
+				VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+			if (vkCreateCommandPool(device, &pool_info, host_callbacks(HOST_SCOPE_COMMAND), &queue->command_pool) != VK_SUCCESS) {
+				log("Failed to create command pool", ERROR);
+			}
 		}
+
+		// Uploads are recorded into the transfer pool, only ever from the render thread
+		uploader.init(device, &allocator, transfer_queue.command_pool);
 	}
 
 	void Program::create_command_buffers() {
-		command_buffers.resize(swap_chain_framebuffers.size());
+		command_buffers.resize(swap_chain_framebuffers.size() * MAX_FRAMES_IN_FLIGHT);
 
 		VkCommandBufferAllocateInfo alloc_info{};
 		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		alloc_info.commandPool = command_pool;
+		alloc_info.commandPool = graphics_queue.command_pool;
 		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 		alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
 
@@ -474,39 +580,257 @@ namespace LLAP {
 			log("failed to allocate command buffers", ERROR);
 		}
 
-		for (size_t i = 0; i < command_buffers.size(); i++) {
-			VkCommandBufferBeginInfo begin_info{};
-			begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			begin_info.flags = 0;
-			begin_info.pInheritanceInfo = nullptr;
+		stale_command_buffers.assign(command_buffers.size(), true);
+		recorded_command_buffers.assign(command_buffers.size(), false);
+	}
+
+	void Program::record_command_buffer(uint32_t image, size_t frame) {
+		size_t i = image * MAX_FRAMES_IN_FLIGHT + frame;
+		size_t host_allocations = host_memory_stats(HOST_SCOPE_COMMAND).allocations;
+		double recording_start = glfwGetTime();
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = 0;
+		begin_info.pInheritanceInfo = nullptr;
+
+		if (vkBeginCommandBuffer(command_buffers[i], &begin_info) != VK_SUCCESS) {
+			log("failed to begin recording command buffer", ERROR);
+		}
+
+		VkRenderPassBeginInfo render_pass_info{};
+		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		render_pass_info.renderPass = render_pass;
+		render_pass_info.framebuffer = swap_chain_framebuffers[image];
+		render_pass_info.renderArea.offset = { 0, 0 };
+		render_pass_info.renderArea.extent = swap_chain_extent;
+
+		VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		render_pass_info.clearValueCount = 1;
+		render_pass_info.pClearValues = &clear_color;
+
+		if (virtual_ready) {
+			virtual_cache.record_clear(command_buffers[i], static_cast<uint32_t>(frame));
+		}
+
+		vkCmdBeginRenderPass(command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
-			if (vkBeginCommandBuffer(command_buffers[i], &begin_info) != VK_SUCCESS) {
-				log("failed to begin recording command buffer", ERROR);
+		vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+
+		if (frame_uniform_size > 0) {
+			// The pool backend selects the partition with a dynamic offset, the push backend writes it
+			uint32_t dynamic_offset = static_cast<uint32_t>(ring.frame_offset(static_cast<uint32_t>(frame)));
+			FrameDescriptorData data{};
+			data.uniforms.buffer = ring.get_buffer();
+			data.uniforms.offset = descriptor_backend == DESCRIPTOR_BACKEND_PUSH ? dynamic_offset : 0;
+			data.uniforms.range = frame_uniform_size;
+			frame_layout.bind(command_buffers[i], frame_set, &data, 1, &dynamic_offset);
+		}
+
+		if (bindless_table() != nullptr) {
+			VkDescriptorSet bindless_set = bindless.get_set();
+			vkCmdBindDescriptorSets(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout,
+				1, 1, &bindless_set, 0, nullptr);
+		}
+
+		size_t draws = 0;
+		for (const auto& mesh : meshes) {
+			if (!mesh.resident) {
+				continue;
+			}
+			draws++;
+
+			MeshConstants constants{};
+			std::memcpy(constants.position_offset, mesh.position_offset, sizeof(constants.position_offset));
+			std::memcpy(constants.position_scale, mesh.position_scale, sizeof(constants.position_scale));
+			vkCmdPushConstants(command_buffers[i], pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+			VkDeviceSize offset = 0;
+			vkCmdBindVertexBuffers(command_buffers[i], 0, 1, &mesh.vertices.buffer, &offset);
+			vkCmdBindIndexBuffer(command_buffers[i], mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+			vkCmdDrawIndexed(command_buffers[i], mesh.index_count, 1, 0, 0, 0);
+		}
+
+		vkCmdEndRenderPass(command_buffers[i]);
+		if (virtual_ready) {
+			virtual_cache.record_readback(command_buffers[i], static_cast<uint32_t>(frame));
+		}
+
+		if (vkEndCommandBuffer(command_buffers[i]) != VK_SUCCESS) {
+			log("Failed to record command buffer!", ERROR);
+		}
+
+		stale_command_buffers[i] = false;
+		recording_seconds = glfwGetTime() - recording_start;
+		recording_draws = draws;
+
+		// The first recording may grow the command buffer, re-recording shouldn't allocate
+		size_t recording_allocations = host_memory_stats(HOST_SCOPE_COMMAND).allocations - host_allocations;
+		if (recorded_command_buffers[i] && recording_allocations > 0 && !warned_recording_allocations) {
+			log("The driver made " + std::to_string(recording_allocations) +
+				" host allocations while re-recording a command buffer", WARNING);
+			warned_recording_allocations = true;
+		}
+		recorded_command_buffers[i] = true;
+	}
+
+	void Program::invalidate_command_buffers() {
+		std::fill(stale_command_buffers.begin(), stale_command_buffers.end(), true);
+	}
+
+	void Program::create_frame_descriptors() {
+		// Sets that live as long as the program
+		descriptor_pool.init(device, 16);
+		frame_descriptors.init(device, MAX_FRAMES_IN_FLIGHT, descriptor_thread_count);
+
+		if (frame_uniform_size == 0) {
+			// The bindless table is set 1, so set 0 needs a layout even if it's empty
+			if (capabilities.descriptor_indexing) {
+				frame_layout.create(device);
 			}
+			return;
+		}
+
+		if (descriptor_backend == DESCRIPTOR_BACKEND_PUSH && !capabilities.push_descriptors) {
+			log("Push descriptors aren't supported, using descriptor pools", WARNING);
+			descriptor_backend = DESCRIPTOR_BACKEND_POOL;
+		}
 
-			VkRenderPassBeginInfo render_pass_info{};
-			render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			render_pass_info.renderPass = render_pass;
-			render_pass_info.framebuffer = swap_chain_framebuffers[i];
-			render_pass_info.renderArea.offset = { 0, 0 };
+		if (descriptor_backend == DESCRIPTOR_BACKEND_PUSH) {
+			// Pushed with the partition's offset when recording
+			frame_layout.binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				offsetof(FrameDescriptorData, uniforms));
+			frame_layout.create(device, DESCRIPTOR_BACKEND_PUSH);
+			return;
+		}
 
-			VkClearValue clear_color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			render_pass_info.clearValueCount = 1;
-			render_pass_info.pClearValues = &clear_color;
+		frame_layout.binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			offsetof(FrameDescriptorData, uniforms));
+		frame_layout.create(device);
+		frame_set = descriptor_pool.allocate(frame_layout.get_layout());
+
+		// One descriptor for every frame, the dynamic offset selects the partition
+		FrameDescriptorData data{};
+		data.uniforms.buffer = ring.get_buffer();
+		data.uniforms.offset = 0;
+		data.uniforms.range = frame_uniform_size;
+		frame_layout.update(device, frame_set, &data);
+	}
 
-			vkCmdBeginRenderPass(command_buffers[i], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+	void Program::create_bindless_table() {
+		if (!capabilities.descriptor_indexing) {
+			return;
+		}
+
+		// Set 0 holds the frame uniforms, if any
+		bindless.init(device, gpu, bindless_texture_count, bindless_buffer_count, bindless_sampler_count,
+			frame_uniform_size > 0 ? 1 : 0);
+	}
 
-			vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
-			vkCmdDraw(command_buffers[i], 3, 1, 0, 0);
-			vkCmdEndRenderPass(command_buffers[i]);
-			if (vkEndCommandBuffer(command_buffers[i]) != VK_SUCCESS) {
-				log("Failed to record command buffer!", ERROR);
+	void Program::create_texture_streamer() {
+		float max_anisotropy = capabilities.sampler_anisotropy ? std::min(8.0f, gpu.properties.limits.maxSamplerAnisotropy) : 0.0f;
+		texture_streamer.init(device, &allocator, &uploader, bindless_table(), shared_families(),
+			texture_thread_count, max_anisotropy);
+	}
+
+	TextureStreamer& Program::textures() {
+		return texture_streamer;
+	}
+
+	uint32_t Program::load_texture(const std::string& path, float priority) {
+		return texture_streamer.load(path, ktx2_loader(physical_device, ktx2_decoder), priority);
+	}
+
+	MipGenerator& Program::mip_generator() {
+		if (!mips_ready) {
+			if (!capabilities.storage_image_write_without_format) {
+				log("Mip generation needs shaderStorageImageWriteWithoutFormat", ERROR);
+			}
+
+			std::vector<uint32_t> families = { graphics_queue.family };
+			if (compute_queue.family != graphics_queue.family) {
+				families.push_back(compute_queue.family);
 			}
+			mips.init(device, &allocator, read_file("downsample.spv"), families);
+			mips_ready = true;
 		}
+		return mips;
+	}
+
+	uint32_t Program::load_virtual_texture(const std::string& path) {
+		if (!virtual_ready) {
+			if (bindless_table() == nullptr || !capabilities.fragment_stores_and_atomics) {
+				log("Virtual textures need descriptor indexing and fragmentStoresAndAtomics", ERROR);
+			}
+
+			VirtualTextureLayout layout = VirtualTextureFile(path).get_layout();
+			VkFormatProperties format_properties;
+			vkGetPhysicalDeviceFormatProperties(physical_device, layout.format, &format_properties);
+			VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+			if ((format_properties.optimalTilingFeatures & required) != required) {
+				log("The device can't sample the format of virtual texture " + path, ERROR);
+			}
+
+			uint32_t atlas_pages = std::min(virtual_atlas_pages, gpu.properties.limits.maxImageDimension2D / layout.padded_size());
+			if (atlas_pages == 0) {
+				log("Pages of virtual texture " + path + " are larger than the device's largest image", ERROR);
+			}
+			virtual_cache.init(device, &allocator, &uploader, &bindless, shared_families(), layout.format,
+				layout.page_size, layout.border, atlas_pages, virtual_max_pages, MAX_FRAMES_IN_FLIGHT, texture_thread_count);
+
+			VkCommandBuffer commands = begin_one_time_commands(QUEUE_GRAPHICS);
+			virtual_cache.record_init(commands);
+			if (vkEndCommandBuffer(commands) != VK_SUCCESS) {
+				log("Failed to record virtual texture atlas transition", ERROR);
+			}
+			wait_queue(QUEUE_GRAPHICS, submit(QUEUE_GRAPHICS, commands));
+			vkFreeCommandBuffers(device, graphics_queue.command_pool, 1, &commands);
+
+			// Every frame clears and reads back its feedback from now on
+			virtual_ready = true;
+			invalidate_command_buffers();
+		}
+
+		return virtual_cache.add(path);
+	}
+
+	VirtualTextureCache& Program::virtual_textures() {
+		if (!virtual_ready) {
+			log("No virtual texture has been loaded", ERROR);
+		}
+		return virtual_cache;
+	}
+
+	BindlessTable* Program::bindless_table() {
+		return bindless.get_layout() != VK_NULL_HANDLE ? &bindless : nullptr;
+	}
+
+	double Program::recording_time_per_draw() const {
+		return recording_seconds / std::max<size_t>(recording_draws, 1);
+	}
+
+	VkDescriptorSet Program::allocate_frame_set(VkDescriptorSetLayout layout, uint32_t thread) {
+		return frame_descriptors.allocate(layout, thread);
+	}
+
+	VkDescriptorSet Program::allocate_set(VkDescriptorSetLayout layout) {
+		return descriptor_pool.allocate(layout);
+	}
+
+	void* Program::frame_uniforms() {
+		return frame_uniform.data;
+	}
+
+	FrameRing& Program::frame_ring() {
+		return ring;
+	}
+
+	std::pmr::memory_resource* Program::frame_memory() {
+		return &arena;
 	}
 
 	void Program::create_graphics_pipeline() {
-		auto vert_shader_code = read_file("vert.spv");
+		auto vert_shader_code = read_file(vertex_shader);
 		auto frag_shader_code = read_file("frag.spv");
 
 		log("Vertex shader buffer size: " +
@@ -536,10 +860,10 @@ namespace LLAP {
 		
 		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
 		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertex_input_info.vertexBindingDescriptionCount = 0;
-		vertex_input_info.pVertexBindingDescriptions = nullptr;
-		vertex_input_info.vertexAttributeDescriptionCount = 0;
-		vertex_input_info.pVertexAttributeDescriptions = nullptr;
+		vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_layout.get_bindings().size());
+		vertex_input_info.pVertexBindingDescriptions = vertex_layout.get_bindings().data();
+		vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_layout.get_attributes().size());
+		vertex_input_info.pVertexAttributeDescriptions = vertex_layout.get_attributes().data();
 
 		VkPipelineInputAssemblyStateCreateInfo input_assembly{};
 		input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -613,14 +937,29 @@ namespace LLAP {
 
 		VkPipelineLayoutCreateInfo pipeline_layout_info{};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipeline_layout_info.setLayoutCount = 0;
-		pipeline_layout_info.pSetLayouts = nullptr;
-		pipeline_layout_info.pushConstantRangeCount = 0;
-		pipeline_layout_info.pPushConstantRanges = nullptr;
+		VkDescriptorSetLayout set_layouts[] = { frame_layout.get_layout(), bindless.get_layout() };
+		if (set_layouts[1] != VK_NULL_HANDLE) {
+			pipeline_layout_info.setLayoutCount = 2;
+		}
+		else {
+			pipeline_layout_info.setLayoutCount = set_layouts[0] != VK_NULL_HANDLE ? 1 : 0;
+		}
+		pipeline_layout_info.pSetLayouts = set_layouts;
 
-		if (vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr, &pipeline_layout) != VK_SUCCESS) {
+		// Position decode of the mesh being drawn, vertex shaders that don't declare it ignore it
+		VkPushConstantRange mesh_constants{};
+		mesh_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		mesh_constants.offset = 0;
+		mesh_constants.size = sizeof(MeshConstants);
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &mesh_constants;
+
+		if (vkCreatePipelineLayout(device, &pipeline_layout_info, host_callbacks(HOST_SCOPE_PIPELINE), &pipeline_layout) != VK_SUCCESS) {
 			log("Failed to create pipeline layout", ERROR);
 		}
+		if (set_layouts[0] != VK_NULL_HANDLE) {
+			frame_layout.attach(device, pipeline_layout, 0);
+		}
 
 		VkGraphicsPipelineCreateInfo pipeline_info{};
 		pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -640,12 +979,12 @@ namespace LLAP {
 		pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 		pipeline_info.basePipelineIndex = -1;
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &graphics_pipeline) != VK_SUCCESS) {
+		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, host_callbacks(HOST_SCOPE_PIPELINE), &graphics_pipeline) != VK_SUCCESS) {
 			log("Failed to create graphics pipeline", ERROR);
 		}
 
-		vkDestroyShaderModule(device, vert_shader_module, nullptr);
-		vkDestroyShaderModule(device, frag_shader_module, nullptr);
+		vkDestroyShaderModule(device, vert_shader_module, host_callbacks(HOST_SCOPE_PIPELINE));
+		vkDestroyShaderModule(device, frag_shader_module, host_callbacks(HOST_SCOPE_PIPELINE));
 	}
 
 	VkShaderModule Program::create_shader_module(const std::vector<char>& code) {
@@ -655,7 +994,7 @@ namespace LLAP {
 		create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
 		VkShaderModule shader_module;
-		if (vkCreateShaderModule(device, &create_info, nullptr, &shader_module) != VK_SUCCESS) {
+		if (vkCreateShaderModule(device, &create_info, host_callbacks(HOST_SCOPE_PIPELINE), &shader_module) != VK_SUCCESS) {
 			log("Failed to create shader module", ERROR);
 		}
 
@@ -699,46 +1038,98 @@ namespace LLAP {
 		render_pass_info.dependencyCount = 1;
 		render_pass_info.pDependencies = &dependency;
 
-		if (vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass)) {
+		if (vkCreateRenderPass(device, &render_pass_info, host_callbacks(HOST_SCOPE_DEVICE), &render_pass)) {
 			log("Failed to create render pass", ERROR);
 		}
 	}
 
 	void Program::draw_frame() {
-		vkWaitForFences(device, 1, &in_flight_fences[current_frame], VK_TRUE, UINT64_MAX);
+		track_memory();
+		defragment();
+		// Uploads become visible to the frames that wait on them, only frames that
+		// start using new data wait, on a value the transfer queue already reached
+		if (texture_streamer.update(memory_pressure ? 0 : texture_bytes_per_frame, submitted_frame(), completed_frame())) {
+			pending_transfer_wait = std::max(pending_transfer_wait, collected_transfer_value);
+		}
+		flush_uploads();
+
+		// Wait for the frame that last used this slot's semaphores and ring partition
+		wait_timeline(graphics_queue.timeline, frame_values[current_frame]);
+
+		ring.begin_frame(static_cast<uint32_t>(current_frame));
+		arena.begin_frame(static_cast<uint32_t>(current_frame));
+		frame_descriptors.begin_frame(static_cast<uint32_t>(current_frame));
+		if (bindless_table() != nullptr) {
+			bindless.release_retired(completed_frame());
+		}
+		if (virtual_ready) {
+			if (virtual_cache.begin_frame(static_cast<uint32_t>(current_frame), virtual_pages_per_frame,
+				submitted_frame(), completed_frame()))
+			{
+				pending_transfer_wait = std::max(pending_transfer_wait, collected_transfer_value);
+			}
+		}
+		if (frame_uniform_size > 0) {
+			// Always the first slice, so its dynamic offset is fixed per slot
+			frame_uniform = ring.allocate_uniform(frame_uniform_size);
+		}
+		loop();
 		
 		uint32_t image_index;
 		vkAcquireNextImageKHR(device, swap_chain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &image_index);
 		
-		if (in_flight_images[image_index] != VK_NULL_HANDLE)
+		if (images_in_flight[image_index] != 0)
 		{
-			vkWaitForFences(device, 1, &in_flight_images[image_index], VK_TRUE, UINT64_MAX);
+			wait_timeline(graphics_queue.timeline, images_in_flight[image_index]);
+		}
+
+		// The last frame in this slot completed, so none of the slot's command buffers are pending
+		size_t command_index = image_index * MAX_FRAMES_IN_FLIGHT + current_frame;
+		if (stale_command_buffers[command_index]) {
+			record_command_buffer(image_index, current_frame);
 		}
 
-		in_flight_images[image_index] = in_flight_fences[current_frame];
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		uint64_t frame_value = graphics_queue.timeline.value + 1;
 
 		VkSubmitInfo submit_info{};
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
-		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submit_info.waitSemaphoreCount = 1;
+		// Also wait on the transfer timeline when this frame reads uploaded or relocated buffers
+		VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame], transfer_queue.timeline.semaphore };
+		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT };
+		uint64_t wait_values[] = { 0, pending_transfer_wait }; // Binary semaphore, value ignored
+		uint32_t wait_count = pending_transfer_wait != 0 ? 2 : 1;
+		pending_transfer_wait = 0;
+		submit_info.waitSemaphoreCount = wait_count;
 		submit_info.pWaitSemaphores = wait_semaphores;
 		submit_info.pWaitDstStageMask = wait_stages;
 		
 		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = &command_buffers[image_index];
+		submit_info.pCommandBuffers = &command_buffers[command_index];
 
-		VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
-		submit_info.signalSemaphoreCount = 1;
+		// The presentation engine only accepts binary semaphores, so signal both
+		VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame], graphics_queue.timeline.semaphore };
+		uint64_t signal_values[] = { 0, frame_value };
+		submit_info.signalSemaphoreCount = 2;
 		submit_info.pSignalSemaphores = signal_semaphores;
+
+		VkTimelineSemaphoreSubmitInfoKHR timeline_info{};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timeline_info.waitSemaphoreValueCount = wait_count;
+		timeline_info.pWaitSemaphoreValues = wait_values;
+		timeline_info.signalSemaphoreValueCount = 2;
+		timeline_info.pSignalSemaphoreValues = signal_values;
+		submit_info.pNext = &timeline_info;
 		
-		vkResetFences(device, 1, &in_flight_fences[current_frame]);
-		
-		if (vkQueueSubmit(graphics_queue, 1, &submit_info, in_flight_fences[current_frame]) != VK_SUCCESS) {
+		if (vkQueueSubmit(graphics_queue.queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
 			log("Failed to submit draw command buffer", ERROR);
 		}
 
+		graphics_queue.timeline.value = frame_value;
+		images_in_flight[image_index] = frame_value;
+		frame_values[current_frame] = frame_value;
+
 		VkPresentInfoKHR present_info{};
 		present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		present_info.waitSemaphoreCount = 1;
@@ -752,6 +1143,7 @@ namespace LLAP {
 
 		vkQueuePresentKHR(present_queue, &present_info);
 		//vkQueueWaitIdle(present_queue);
+		lock.unlock();
 
 		current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
 	}
@@ -759,24 +1151,374 @@ namespace LLAP {
 	void Program::create_semaphores() {
 		image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-		in_flight_images.resize(swap_chain_images.size(), VK_NULL_HANDLE);
+		images_in_flight.resize(swap_chain_images.size(), 0);
+		frame_values.resize(MAX_FRAMES_IN_FLIGHT, 0);
 
 		VkSemaphoreCreateInfo semaphore_info{};
 		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo fence_info{};
-		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-			if (vkCreateSemaphore(device, &semaphore_info, nullptr, &image_available_semaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(device, &semaphore_info, nullptr, &render_finished_semaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(device, &fence_info, nullptr, &in_flight_fences[i]) != VK_SUCCESS) {
+			if (vkCreateSemaphore(device, &semaphore_info, host_callbacks(HOST_SCOPE_DEVICE), &image_available_semaphores[i]) != VK_SUCCESS ||
+				vkCreateSemaphore(device, &semaphore_info, host_callbacks(HOST_SCOPE_DEVICE), &render_finished_semaphores[i]) != VK_SUCCESS) {
 
 				log("failed to create semaphores for a frame", ERROR);
 			}
 		}
+
+		create_timeline(graphics_queue.timeline);
+		create_timeline(compute_queue.timeline);
+		create_timeline(transfer_queue.timeline);
+	}
+
+	void Program::load_timeline_functions() {
+		vk_wait_semaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+		vk_get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+
+		if (vk_wait_semaphores == nullptr || vk_get_semaphore_counter_value == nullptr) {
+			log("Failed to load timeline semaphore functions", ERROR);
+		}
+	}
+
+	void Program::create_timeline(Timeline& timeline) {
+		VkSemaphoreTypeCreateInfoKHR type_info{};
+		type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		type_info.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphore_info{};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphore_info.pNext = &type_info;
+
+		if (vkCreateSemaphore(device, &semaphore_info, host_callbacks(HOST_SCOPE_DEVICE), &timeline.semaphore) != VK_SUCCESS) {
+			log("Failed to create timeline semaphore", ERROR);
+		}
+
+		timeline.value = 0;
+	}
+
+	void Program::wait_timeline(const Timeline& timeline, uint64_t value) {
+		VkSemaphoreWaitInfoKHR wait_info{};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &timeline.semaphore;
+		wait_info.pValues = &value;
+
+		if (vk_wait_semaphores(device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+			log("Failed to wait on timeline semaphore", ERROR);
+		}
+	}
+
+	uint64_t Program::submitted_frame() const {
+		return graphics_queue.timeline.value;
+	}
+
+	uint64_t Program::timeline_counter(const Timeline& timeline) {
+		uint64_t value = 0;
+		vk_get_semaphore_counter_value(device, timeline.semaphore, &value);
+		return value;
+	}
+
+	uint64_t Program::completed_frame() {
+		return timeline_counter(graphics_queue.timeline);
+	}
+
+	void Program::wait_for_frame(uint64_t frame) {
+		wait_timeline(graphics_queue.timeline, std::min(frame, graphics_queue.timeline.value));
+	}
+
+	uint64_t Program::submit(QUEUE_TYPE type, VkCommandBuffer command_buffer, const TimelineWait* waits, uint32_t wait_count) {
+		if (wait_count > MAX_TIMELINE_WAITS) {
+			log("Too many timeline waits in one submission", ERROR);
+		}
+
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		Queue& queue = get_queue(type);
+		uint64_t signal_value = queue.timeline.value + 1;
+
+		VkSemaphore wait_semaphores[MAX_TIMELINE_WAITS];
+		uint64_t wait_values[MAX_TIMELINE_WAITS];
+		VkPipelineStageFlags wait_stages[MAX_TIMELINE_WAITS];
+		for (uint32_t i = 0; i < wait_count; i++) {
+			wait_semaphores[i] = get_queue(waits[i].queue).timeline.semaphore;
+			wait_values[i] = waits[i].value;
+			wait_stages[i] = waits[i].stage;
+		}
+
+		VkTimelineSemaphoreSubmitInfoKHR timeline_info{};
+		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timeline_info.waitSemaphoreValueCount = wait_count;
+		timeline_info.pWaitSemaphoreValues = wait_values;
+		timeline_info.signalSemaphoreValueCount = 1;
+		timeline_info.pSignalSemaphoreValues = &signal_value;
+
+		VkSubmitInfo submit_info{};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.pNext = &timeline_info;
+		submit_info.waitSemaphoreCount = wait_count;
+		submit_info.pWaitSemaphores = wait_semaphores;
+		submit_info.pWaitDstStageMask = wait_stages;
+		submit_info.commandBufferCount = command_buffer != VK_NULL_HANDLE ? 1 : 0;
+		submit_info.pCommandBuffers = &command_buffer;
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = &queue.timeline.semaphore;
+
+		if (vkQueueSubmit(queue.queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			log("Failed to submit command buffer", ERROR);
+		}
+
+		queue.timeline.value = signal_value;
+		return signal_value;
+	}
+
+	void Program::wait_queue(QUEUE_TYPE type, uint64_t value) {
+		wait_timeline(get_queue(type).timeline, value);
+	}
+
+	uint32_t Program::queue_family(QUEUE_TYPE type) {
+		return get_queue(type).family;
+	}
+
+	VkCommandPool Program::queue_command_pool(QUEUE_TYPE type) {
+		return get_queue(type).command_pool;
+	}
+
+	VkDevice Program::get_device() const {
+		return device;
+	}
+
+	const Capabilities& Program::get_capabilities() const {
+		return capabilities;
+	}
+
+	Buffer Program::create_device_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MEMORY_CATEGORY category) {
+		// Shared with the transfer family so uploads and defragmentation need no ownership transfers
+		return create_buffer(device, allocator, size,
+			usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			category,
+			shared_families());
+	}
+
+	void Program::destroy_device_buffer(Buffer& buffer) {
+		destroy_buffer(device, allocator, buffer);
+	}
+
+	std::future<void> Program::upload(const Buffer& dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+		return uploader.upload(dst.buffer, dst_offset, data, size);
+	}
+
+	void Program::flush_uploads() {
+		// Futures made ready here, meshes and upload() callers alike, may be used by this frame
+		uint64_t collected = uploader.collect(timeline_counter(transfer_queue.timeline));
+		if (collected != 0) {
+			collected_transfer_value = collected;
+			pending_transfer_wait = std::max(pending_transfer_wait, collected);
+		}
+
+		VkCommandBuffer commands = uploader.record(upload_bytes_per_frame);
+		if (commands != VK_NULL_HANDLE) {
+			uploader.submitted(submit(QUEUE_TRANSFER, commands));
+		}
+
+		// Meshes are drawn, and may be moved, once both their buffers arrived
+		for (auto it = pending_meshes.begin(); it != pending_meshes.end();) {
+			if (it->vertices.wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+				it->indices.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++it;
+				continue;
+			}
+
+			Mesh& mesh = meshes[it->index];
+			mesh.resident = true;
+
+			std::vector<uint32_t> families = shared_families();
+			defragmenter.track(&mesh.vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, families);
+			defragmenter.track(&mesh.indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, families);
+			invalidate_command_buffers();
+
+			it = pending_meshes.erase(it);
+		}
+	}
+
+	std::vector<uint32_t> Program::shared_families() const {
+		if (graphics_queue.family == transfer_queue.family) {
+			return {};
+		}
+		return { graphics_queue.family, transfer_queue.family };
+	}
+
+	VkCommandBuffer Program::begin_one_time_commands(QUEUE_TYPE type) {
+		VkCommandBufferAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.commandPool = get_queue(type).command_pool;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandBufferCount = 1;
+
+		VkCommandBuffer command_buffer;
+		if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+			log("Failed to allocate command buffer", ERROR);
+		}
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+			log("Failed to begin recording command buffer", ERROR);
+		}
+
+		return command_buffer;
+	}
+
+	uint32_t Program::load_mesh(const std::string& path) {
+		MeshFile file(path);
+
+		const auto& bindings = vertex_layout.get_bindings();
+		if (bindings.size() != 1 || bindings[0].stride != file.vertex_stride()) {
+			log("Mesh " + path + " doesn't match the stride of vertex_layout", ERROR);
+		}
+		for (const auto& attribute : vertex_layout.get_attributes()) {
+			const auto& attributes = file.get_attributes();
+			bool found = std::any_of(attributes.begin(), attributes.end(), [&](const MeshAttribute& candidate) {
+				return candidate.location == attribute.location && candidate.format == attribute.format &&
+					candidate.offset == attribute.offset;
+			});
+			if (!found) {
+				log("Mesh " + path + " has no attribute at location " + std::to_string(attribute.location) +
+					" the way vertex_layout reads it", ERROR);
+			}
+		}
+
+		uint32_t index = add_mesh(file.vertex_data(), file.vertex_size(), file.index_data(), file.index_count());
+		std::memcpy(meshes[index].position_offset, file.position_offset(), sizeof(meshes[index].position_offset));
+		std::memcpy(meshes[index].position_scale, file.position_scale(), sizeof(meshes[index].position_scale));
+		return index;
+	}
+
+	const Mesh& Program::get_mesh(uint32_t index) const {
+		return meshes[index];
+	}
+
+	uint32_t Program::add_mesh(const void* vertices, VkDeviceSize vertices_size, const uint32_t* indices, uint32_t index_count) {
+		// Transfer source too, so defragmentation can copy them out
+		meshes.emplace_back();
+		Mesh& mesh = meshes.back();
+		mesh.vertices = create_device_buffer(vertices_size,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEMORY_GEOMETRY);
+		mesh.indices = create_device_buffer(sizeof(uint32_t) * index_count,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MEMORY_GEOMETRY);
+		mesh.index_count = index_count;
+
+		uint32_t index = static_cast<uint32_t>(meshes.size() - 1);
+
+		PendingMesh pending;
+		pending.index = index;
+		pending.vertices = uploader.upload(mesh.vertices.buffer, 0, vertices, vertices_size);
+		pending.indices = uploader.upload(mesh.indices.buffer, 0, indices, sizeof(uint32_t) * index_count);
+		pending_meshes.push_back(std::move(pending));
+
+		return index;
+	}
+
+	void Program::defragment() {
+		// Swap in the last batch once its copies are done. Frames submitted so far
+		// may still read the old buffers, later ones re-record their command buffers.
+		if (defragmenter.moving() && timeline_counter(transfer_queue.timeline) >= defrag_value) {
+			VkDeviceSize moved = defragmenter.commit_moves(graphics_queue.timeline.value);
+			vkFreeCommandBuffers(device, transfer_queue.command_pool, 1, &defrag_commands);
+			defrag_commands = VK_NULL_HANDLE;
+
+			if (moved > 0) {
+				pending_transfer_wait = std::max(pending_transfer_wait, defrag_value);
+				invalidate_command_buffers();
+
+				MemoryStats stats = allocator.stats();
+				char line[128];
+				std::snprintf(line, sizeof(line), "Defragmented %llu bytes, %u blocks, fragmentation %.3f",
+					static_cast<unsigned long long>(moved), stats.block_count, stats.fragmentation);
+				log(line);
+			}
+		}
+
+		defragmenter.release_retired(timeline_counter(graphics_queue.timeline));
+
+		// Uploads write to buffers the defragmenter could pick, keep them apart
+		if (defrag_bytes_per_frame == 0 || !defragmenter.has_candidate() || !uploader.idle()) {
+			return;
+		}
+
+		VkCommandBuffer commands = begin_one_time_commands(QUEUE_TRANSFER);
+		bool recorded = defragmenter.record_moves(commands, defrag_bytes_per_frame);
+		vkEndCommandBuffer(commands);
+
+		if (recorded) {
+			defrag_commands = commands;
+			defrag_value = submit(QUEUE_TRANSFER, commands);
+		}
+		else {
+			vkFreeCommandBuffers(device, transfer_queue.command_pool, 1, &commands);
+		}
+	}
+
+	MemoryStats Program::memory_stats() const {
+		return allocator.stats();
+	}
+
+	void Program::track_memory() {
+		allocator.update_budget();
+		MemoryStats stats = allocator.stats();
+
+		memory_pressure = false;
+		for (uint32_t i = 0; i < stats.heap_count; i++) {
+			const HeapBudget& heap = stats.heaps[i];
+			VkDeviceSize threshold = static_cast<VkDeviceSize>(heap.budget * memory_pressure_threshold);
+			if (heap.budget > 0 && heap.usage > threshold) {
+				// Textures give up their finest levels first, they stream back in once there's room
+				if (heap.device_local) {
+					// Bytes already being released don't count twice
+					memory_pressure = true;
+					VkDeviceSize excess = heap.usage - threshold;
+					VkDeviceSize evicting = texture_streamer.evicting_bytes();
+					if (excess > evicting) {
+						texture_streamer.evict(excess - evicting);
+					}
+				}
+				on_memory_pressure(i, stats);
+			}
+		}
+
+		double now = glfwGetTime();
+		if (memory_log_interval <= 0.0 || now - last_memory_log < memory_log_interval) {
+			return;
+		}
+		last_memory_log = now;
+
+		// Formatted on the stack, the frame loop doesn't touch the heap
+		const unsigned long long MiB = 1024 * 1024;
+		char line[1024];
+		int length = std::snprintf(line, sizeof(line), "GPU memory:");
+		auto append = [&](const char* format, auto... values) {
+			if (length >= 0 && length < static_cast<int>(sizeof(line))) {
+				length += std::snprintf(line + length, sizeof(line) - length, format, values...);
+			}
+		};
+
+		for (uint32_t i = 0; i < stats.heap_count; i++) {
+			const HeapBudget& heap = stats.heaps[i];
+			append(" heap %u (%s) %llu/%llu MiB,", i, heap.device_local ? "device" : "host",
+				static_cast<unsigned long long>(heap.usage) / MiB, static_cast<unsigned long long>(heap.budget) / MiB);
+		}
+		for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+			append(" %s %llu KiB,", memory_category_name(static_cast<MEMORY_CATEGORY>(i)),
+				static_cast<unsigned long long>(stats.category_bytes[i]) / 1024);
+		}
+		append("%s", " driver host");
+		for (uint32_t i = 0; i < HOST_SCOPE_COUNT; i++) {
+			HostScopeStats host = host_memory_stats(static_cast<HOST_SCOPE>(i));
+			append(" %s %llu KiB%s", host_scope_name(static_cast<HOST_SCOPE>(i)),
+				static_cast<unsigned long long>(host.bytes + host.internal_bytes) / 1024, i + 1 < HOST_SCOPE_COUNT ? "," : "");
+		}
+		log(line);
 	}
 
 	void Program::create_instance() {
@@ -791,7 +1533,7 @@ namespace LLAP {
 		app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		app_info.pEngineName = "No Engine";
 		app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		app_info.apiVersion = VK_API_VERSION_1_0;
+		app_info.apiVersion = VK_API_VERSION_1_2;
 
 		VkInstanceCreateInfo create_info{};
 		create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -816,7 +1558,7 @@ namespace LLAP {
 			create_info.pNext = nullptr;
 		}
 
-		if (vkCreateInstance(&create_info, nullptr, &instance) != VK_SUCCESS) {
+		if (vkCreateInstance(&create_info, host_callbacks(HOST_SCOPE_INSTANCE), &instance) != VK_SUCCESS) {
 			log("Failed to create instance", ERROR);
 			throw std::runtime_error("failed to create instance!");
 		}
@@ -840,12 +1582,13 @@ namespace LLAP {
 		VkDebugUtilsMessengerCreateInfoEXT create_info{};
 		populate_debug_messenger_create_info(create_info);
 
-		if (create_debug_utils_messenger_EXT(instance, &create_info, nullptr, &debug_messenger) != VK_SUCCESS) {
+		if (create_debug_utils_messenger_EXT(instance, &create_info, host_callbacks(HOST_SCOPE_INSTANCE), &debug_messenger) != VK_SUCCESS) {
 			throw std::runtime_error("failed to set up debug messenger!");
 		}
 	}
 
 	void Program::init_vulkan() {
+		set_host_memory_limit(host_memory_limit);
 		create_instance();
 		setup_debug_messenger();
 		create_surface();
@@ -854,52 +1597,119 @@ namespace LLAP {
 		create_swap_chain();
 		create_image_views();
 		create_render_pass();
+		create_frame_descriptors();
+		create_bindless_table();
 		create_graphics_pipeline();
 		create_frame_buffers();
 		create_command_pool();
 		create_command_buffers();
 		create_semaphores();
+		create_texture_streamer();
 	}
 
 	void Program::loop_program() {
+		if (const char* fail = std::getenv("LLAP_FAIL_ON_ALLOCATION")) {
+			fail_on_frame_allocation = std::string(fail) != "0";
+		}
+
+		uint64_t frame = 0;
 		while (!glfwWindowShouldClose(window)) {
+			AllocationCounts before = thread_allocations();
 			glfwPollEvents();
 			draw_frame();
+			check_frame_allocations(frame++, before);
 		}
 
-		//vkDeviceWaitIdle(device);
+		vkDeviceWaitIdle(device);
+
+		if (allocating_frames > 0) {
+			log(std::to_string(allocating_frames) + " of " + std::to_string(frame - std::min<uint64_t>(frame, allocation_warmup_frames)) +
+				" frames after warm-up allocated from the heap", WARNING);
+		}
+	}
+
+	void Program::check_frame_allocations(uint64_t frame, const AllocationCounts& before) {
+		if (!allocation_guard_enabled() || frame < allocation_warmup_frames) {
+			return;
+		}
+
+		AllocationCounts after = thread_allocations();
+		size_t count = after.count - before.count;
+		if (count == 0) {
+			return;
+		}
+		allocating_frames++;
+
+		std::string message = "Frame " + std::to_string(frame) + " made " + std::to_string(count) +
+			" heap allocations, " + std::to_string(after.bytes - before.bytes) + " bytes";
+		if (fail_on_frame_allocation) {
+			log(message, ERROR);
+		}
+		if (allocating_frames <= MAX_ALLOCATION_REPORTS) {
+			log(message, WARNING);
+		}
 	}
 
 	void Program::cleanup_program() {
+		if (defrag_commands != VK_NULL_HANDLE) {
+			vkFreeCommandBuffers(device, transfer_queue.command_pool, 1, &defrag_commands);
+		}
+		defragmenter.cleanup();
+		texture_streamer.cleanup();
+		if (virtual_ready) {
+			virtual_cache.cleanup();
+		}
+		if (mips_ready) {
+			mips.cleanup();
+		}
+		uploader.cleanup();
+		pending_meshes.clear();
+
+		for (auto& mesh : meshes) {
+			destroy_buffer(device, allocator, mesh.vertices);
+			destroy_buffer(device, allocator, mesh.indices);
+		}
+		ring.cleanup();
+		arena.cleanup();
+		allocator.cleanup();
+
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-			vkDestroySemaphore(device, render_finished_semaphores[i], nullptr);
-			vkDestroySemaphore(device, image_available_semaphores[i], nullptr);
-			vkDestroyFence(device, in_flight_fences[i], nullptr);
+			vkDestroySemaphore(device, render_finished_semaphores[i], host_callbacks(HOST_SCOPE_DEVICE));
+			vkDestroySemaphore(device, image_available_semaphores[i], host_callbacks(HOST_SCOPE_DEVICE));
+		}
+
+		for (Queue* queue : { &graphics_queue, &compute_queue, &transfer_queue }) {
+			vkDestroySemaphore(device, queue->timeline.semaphore, host_callbacks(HOST_SCOPE_DEVICE));
+			vkDestroyCommandPool(device, queue->command_pool, host_callbacks(HOST_SCOPE_COMMAND));
 		}
-		
-		vkDestroyCommandPool(device, command_pool, nullptr);
 		
 		for (auto framebuffer : swap_chain_framebuffers) {
-			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			vkDestroyFramebuffer(device, framebuffer, host_callbacks(HOST_SCOPE_DEVICE));
 		}
 		
-		vkDestroyPipeline(device, graphics_pipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
-		vkDestroyRenderPass(device, render_pass, nullptr);
+		vkDestroyPipeline(device, graphics_pipeline, host_callbacks(HOST_SCOPE_PIPELINE));
+		vkDestroyPipelineLayout(device, pipeline_layout, host_callbacks(HOST_SCOPE_PIPELINE));
+		frame_descriptors.cleanup();
+		descriptor_pool.cleanup();
+		frame_layout.destroy(device);
+		if (bindless_table() != nullptr) {
+			bindless.cleanup();
+		}
+		vkDestroyRenderPass(device, render_pass, host_callbacks(HOST_SCOPE_DEVICE));
 
 		for (auto image_view : swap_chain_image_views) {
-			vkDestroyImageView(device, image_view, nullptr);
+			vkDestroyImageView(device, image_view, host_callbacks(HOST_SCOPE_DEVICE));
 		}
 
-		vkDestroySwapchainKHR(device, swap_chain, nullptr);
-		vkDestroyDevice(device, nullptr);
+		vkDestroySwapchainKHR(device, swap_chain, host_callbacks(HOST_SCOPE_DEVICE));
+		vkDestroyDevice(device, host_callbacks(HOST_SCOPE_DEVICE));
 
 		if (enable_validation_layers) {
-			destroy_debug_utils_messenger_EXT(instance, debug_messenger, nullptr);
+			destroy_debug_utils_messenger_EXT(instance, debug_messenger, host_callbacks(HOST_SCOPE_INSTANCE));
 		}
 
-		vkDestroySurfaceKHR(instance, surface, nullptr);
-		vkDestroyInstance(instance, nullptr);
+		vkDestroySurfaceKHR(instance, surface, host_callbacks(HOST_SCOPE_INSTANCE));
+		vkDestroyInstance(instance, host_callbacks(HOST_SCOPE_INSTANCE));
 
 		glfwDestroyWindow(window);
 
@@ -11,21 +11,57 @@
 #include <optional>
 #include <set>
 #include <algorithm>
+#include <deque>
+#include <future>
+#include <mutex>
 
 #include "debug.h"
 #include "io.h"
+#include "host_memory.h"
+#include "allocation_guard.h"
+#include "snapshot.h"
+#include "capabilities.h"
+#include "allocator.h"
+#include "buffer.h"
+#include "defrag.h"
+#include "ring.h"
+#include "arena.h"
+#include "upload.h"
+#include "mesh.h"
+#include "descriptors.h"
+#include "bindless.h"
+#include "image.h"
+#include "texture.h"
+#include "ktx.h"
+#include "mips.h"
+#include "mesh_file.h"
+#include "virtual_texture.h"
 
 namespace LLAP {
 
-	struct QueueFamilyIndices {
-		std::optional<uint32_t> graphics_family;
-		std::optional<uint32_t> present_family;
+	typedef enum QUEUE_TYPE {
+		QUEUE_GRAPHICS,
+		QUEUE_COMPUTE,
+		QUEUE_TRANSFER,
+	} QUEUE_TYPE;
+
+	struct Timeline {
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		uint64_t value = 0; // Last value handed out to a submission
+	};
+
+	struct Queue {
+		VkQueue queue = VK_NULL_HANDLE;
+		uint32_t family = 0;
+		VkCommandPool command_pool = VK_NULL_HANDLE;
+		Timeline timeline;
 	};
 
-	struct SwapChainSupportDetails {
-		VkSurfaceCapabilitiesKHR capabilities;
-		std::vector<VkSurfaceFormatKHR> formats;
-		std::vector<VkPresentModeKHR> present_modes;
+	// Makes a submission wait until a queue's timeline reaches value
+	struct TimelineWait {
+		QUEUE_TYPE queue;
+		uint64_t value;
+		VkPipelineStageFlags stage;
 	};
 
 	class Program {
@@ -34,6 +70,122 @@ namespace LLAP {
 		static const int WIDTH = 800, HEIGHT = 600;
 		static const int MAX_FRAMES_IN_FLIGHT = 2;
 
+		// Device index or part of a device name to use instead of the highest
+		// scoring GPU. The LLAP_GPU environment variable overrides it.
+		std::string preferred_gpu;
+
+		// Directory to persist device snapshots in, empty to always query the
+		// driver. The LLAP_DEVICE_CACHE environment variable overrides it.
+		std::string device_cache_directory;
+
+		// Vertex input of the graphics pipeline, declare it before run()
+		VertexLayout vertex_layout;
+		// quantized_vert.spv draws meshes written by quantize_mesh(), every draw
+		// pushes the mesh' position decode to the vertex stage
+		std::string vertex_shader = "vert.spv";
+
+		// Queues a mesh for upload to device local memory, the vertices must match
+		// vertex_layout. It is drawn once the upload completed. Returns the mesh index.
+		uint32_t add_mesh(const void* vertices, VkDeviceSize vertices_size, const uint32_t* indices, uint32_t index_count);
+		// add_mesh() with the streams of a .llmesh file, copied from the mapping into
+		// staging. Its attributes must be the ones vertex_layout reads.
+		uint32_t load_mesh(const std::string& path);
+		// Position decode of quantized meshes lives in the mesh, draws push it to vertex_shader
+		const Mesh& get_mesh(uint32_t index) const;
+
+		// Device local buffers that upload() can fill from any thread. The future is
+		// ready once the copy completed, frames submitted after that see the data.
+		// Destroy buffers only once no frame uses them.
+		Buffer create_device_buffer(VkDeviceSize size, VkBufferUsageFlags usage, MEMORY_CATEGORY category);
+		void destroy_device_buffer(Buffer& buffer);
+		std::future<void> upload(const Buffer& dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+
+		// Bytes of uploads recorded per frame, larger uploads still go one at a time
+		VkDeviceSize upload_bytes_per_frame = 8 * 1024 * 1024;
+
+		// Textures load on texture_thread_count threads and stream finer levels
+		// within texture_bytes_per_frame. Their finest levels are evicted when a
+		// device local heap goes past memory_pressure_threshold.
+		TextureStreamer& textures();
+		// Streams a KTX2 texture, returns its TextureStreamer handle
+		uint32_t load_texture(const std::string& path, float priority = 0.0f);
+		// Inflates Zstandard or ZLIB supercompressed KTX2 levels, LLAP has no decoder of its own
+		Ktx2Decoder ktx2_decoder;
+
+		// Single dispatch mip generation for render targets and runtime generated
+		// textures, created on first use from downsample.spv
+		MipGenerator& mip_generator();
+		uint32_t texture_thread_count = 2;
+		VkDeviceSize texture_bytes_per_frame = 16 * 1024 * 1024;
+
+		// Virtual textures are sampled with virtual_texture.glsl, loop() passes the
+		// frame slot's bindings to shaders. The first .vtex file creates the cache
+		// with its format and page layout, an atlas of virtual_atlas_pages per side.
+		// Needs the bindless table and fragmentStoresAndAtomics.
+		uint32_t load_virtual_texture(const std::string& path);
+		VirtualTextureCache& virtual_textures();
+		uint32_t virtual_atlas_pages = 32;
+		uint32_t virtual_max_pages = 1 << 18;
+		uint32_t virtual_pages_per_frame = 32;
+
+		// Size of the uniform block at set 0, binding 0 that loop() fills every
+		// frame, 0 for none. Declare it before run().
+		VkDeviceSize frame_uniform_size = 0;
+		// Bytes each frame in flight may take from the frame ring
+		VkDeviceSize frame_ring_size = 1024 * 1024;
+
+		// Only valid inside loop(). The ring partition of the current frame is no
+		// longer in use by the GPU when loop() runs.
+		void* frame_uniforms();
+		FrameRing& frame_ring();
+
+		// Transient CPU memory of the current frame for std::pmr containers, reset
+		// when the frame slot comes round again. Only valid inside loop().
+		std::pmr::memory_resource* frame_memory();
+		size_t frame_arena_size = 1024 * 1024;
+		bool frame_arena_huge_pages = false;
+
+		// Descriptor sets that stay valid until the program ends, write them with
+		// DescriptorLayout::update
+		VkDescriptorSet allocate_set(VkDescriptorSetLayout layout);
+		// Descriptor sets for the current frame only, freed when its slot comes round
+		// again. Each thread passes its own index below descriptor_thread_count.
+		VkDescriptorSet allocate_frame_set(VkDescriptorSetLayout layout, uint32_t thread = 0);
+		uint32_t descriptor_thread_count = 1;
+
+		// How the frame uniforms reach shaders, the pool backend is used when the
+		// device lacks VK_KHR_push_descriptor. Set before init_vulkan().
+		DESCRIPTOR_BACKEND descriptor_backend = DESCRIPTOR_BACKEND_POOL;
+		// CPU seconds per draw the last command buffer recording took
+		double recording_time_per_draw() const;
+
+		// Set 1 of every pipeline, resources are referenced by index from shaders.
+		// nullptr when the device lacks descriptor indexing.
+		BindlessTable* bindless_table();
+		uint32_t bindless_texture_count = 16384;
+		uint32_t bindless_buffer_count = 4096;
+		uint32_t bindless_sampler_count = 64;
+
+		// Bytes of buffers the defragmenter may copy per frame, 0 disables it
+		VkDeviceSize defrag_bytes_per_frame = 4 * 1024 * 1024;
+		MemoryStats memory_stats() const;
+
+		// on_memory_pressure() is called every frame a heap uses more than this share
+		// of its budget, leaving room to evict before the driver pages or fails
+		float memory_pressure_threshold = 0.9f;
+		// Seconds between memory usage log lines, 0 disables them
+		double memory_log_interval = 10.0;
+
+		// Frames after warm-up shouldn't allocate from the heap. Builds with the
+		// allocation guard report those that do, or fail the run with this set.
+		// The LLAP_FAIL_ON_ALLOCATION environment variable overrides it.
+		uint32_t allocation_warmup_frames = 120;
+		bool fail_on_frame_allocation = false;
+
+		// Cap on driver host memory, past it Vulkan calls fail with
+		// VK_ERROR_OUT_OF_HOST_MEMORY. 0 for none, set it before run().
+		size_t host_memory_limit = 0;
+
 	private:
 		VkInstance instance;
 		VkDebugUtilsMessengerEXT debug_messenger;
@@ -66,7 +218,8 @@ namespace LLAP {
 			const VkAllocationCallbacks* allocator);
 
 		const std::vector<const char*> device_extensions = {
-			VK_KHR_SWAPCHAIN_EXTENSION_NAME
+			VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+			VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
 		};
 
 		// Swap chain
@@ -77,14 +230,13 @@ namespace LLAP {
 		VkFormat swap_chain_image_format;
 		VkExtent2D swap_chain_extent;
 		void create_frame_buffers();
-		SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device);
 		VkSurfaceFormatKHR choose_swap_surface_format(const std::vector<VkSurfaceFormatKHR>& available_formats);
 		VkPresentModeKHR choose_swap_present_mode(const std::vector<VkPresentModeKHR>& available_present_modes);
 		VkExtent2D choose_swap_extent(const VkSurfaceCapabilitiesKHR& capabilities);
 		void create_swap_chain();
 		void create_image_views();
 
-		bool check_device_extension_support(VkPhysicalDevice device);
+		bool check_device_extension_support(const DeviceSnapshot& snapshot);
 
 #ifdef NDEBUG
 		const bool enable_validation_layers = false;
@@ -98,23 +250,102 @@ namespace LLAP {
 
 		// Device
 		VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+		DeviceSnapshot gpu; // Snapshot of physical_device
 		void pick_gpu();
-		bool is_gpu_suitable(VkPhysicalDevice device);
+		bool is_gpu_suitable(const DeviceSnapshot& snapshot);
+		int64_t rate_gpu(const DeviceSnapshot& snapshot); // -1 when unsuitable
 
 		// Logical device
 		VkDevice device;
+		Capabilities capabilities;
+		Allocator allocator;
 		void create_logical_device();
 
 		// Queue
-		VkQueue graphics_queue;
+		Queue graphics_queue;
+		Queue compute_queue;
+		Queue transfer_queue;
 		VkQueue present_queue;
-		QueueFamilyIndices find_queue_families(VkPhysicalDevice device);
+		// Roles sharing a family share one VkQueue, which needs external
+		// synchronization. Held around every vkQueueSubmit and vkQueuePresentKHR.
+		std::mutex queue_mutex;
+		Queue& get_queue(QUEUE_TYPE type);
 
 		// Command buffers
-		VkCommandPool command_pool;
+		// One per swap chain image and frame slot, at image * MAX_FRAMES_IN_FLIGHT + slot.
+		// The slot's ring offset and feedback buffer are baked in, so a buffer is only
+		// re-recorded when stale.
 		std::vector<VkCommandBuffer> command_buffers;
+		std::vector<bool> stale_command_buffers; // Re-recorded the next time they're used
+		std::vector<bool> recorded_command_buffers;
+		bool warned_recording_allocations = false;
+		double recording_seconds = 0.0;
+		size_t recording_draws = 0;
 		void create_command_pool();
 		void create_command_buffers();
+		void record_command_buffer(uint32_t image, size_t frame);
+		void invalidate_command_buffers();
+		VkCommandBuffer begin_one_time_commands(QUEUE_TYPE type);
+
+		// Geometry
+		std::deque<Mesh> meshes; // Stable addresses for the defragmenter
+		struct MeshConstants {
+			float position_offset[3];
+			float padding; // std430 aligns the vec3 that follows to 16 bytes
+			float position_scale[3];
+		};
+		uint64_t pending_transfer_wait = 0; // Transfer timeline value the next frame waits on
+		uint64_t collected_transfer_value = 0; // Last upload batch whose futures are ready
+		std::vector<uint32_t> shared_families() const;
+
+		// Uploads
+		struct PendingMesh {
+			uint32_t index;
+			std::future<void> vertices;
+			std::future<void> indices;
+		};
+
+		Uploader uploader;
+		std::vector<PendingMesh> pending_meshes;
+		void flush_uploads();
+
+		// Defragmentation
+		Defragmenter defragmenter;
+		VkCommandBuffer defrag_commands = VK_NULL_HANDLE;
+		uint64_t defrag_value = 0;
+		void defragment();
+
+		// Memory budget
+		double last_memory_log = 0.0;
+		void track_memory();
+
+		// Per frame data
+		FrameRing ring;
+		FrameArena arena;
+		RingSlice frame_uniform;
+		struct FrameDescriptorData {
+			VkDescriptorBufferInfo uniforms;
+		};
+		DescriptorLayout frame_layout;
+		VkDescriptorSet frame_set = VK_NULL_HANDLE; // Pool backend only
+
+		// Descriptors
+		DescriptorPool descriptor_pool;
+		FrameDescriptors frame_descriptors;
+		void create_frame_descriptors();
+
+		// Bindless resources
+		BindlessTable bindless;
+		void create_bindless_table();
+
+		// Textures
+		TextureStreamer texture_streamer;
+		MipGenerator mips;
+		bool mips_ready = false;
+		VirtualTextureCache virtual_cache;
+		bool virtual_ready = false;
+		bool memory_pressure = false; // A device local heap is past memory_pressure_threshold
+		void create_texture_streamer();
 
 		// Graphics pipeline
 		VkPipeline graphics_pipeline;
@@ -128,16 +359,23 @@ namespace LLAP {
 		void draw_frame();
 
 		// Semaphores
-		VkSemaphore image_available_s;
-		VkSemaphore render_finished_s;
 		void create_semaphores();
 
 		size_t current_frame = 0;
-		std::vector<VkFence> in_flight_fences;
-		std::vector<VkFence> in_flight_images;
+		std::vector<uint64_t> images_in_flight; // Graphics timeline value of the last frame to use each image
+		std::vector<uint64_t> frame_values; // Graphics timeline value of the last frame to use each frame slot
 		std::vector<VkSemaphore> image_available_semaphores;
 		std::vector<VkSemaphore> render_finished_semaphores;
 
+		// Timeline semaphores
+		static const uint32_t MAX_TIMELINE_WAITS = 4;
+		PFN_vkWaitSemaphoresKHR vk_wait_semaphores;
+		PFN_vkGetSemaphoreCounterValueKHR vk_get_semaphore_counter_value;
+		void load_timeline_functions();
+		void create_timeline(Timeline& timeline);
+		void wait_timeline(const Timeline& timeline, uint64_t value);
+		uint64_t timeline_counter(const Timeline& timeline);
+
 		void create_instance();
 		void init_vulkan();
 
@@ -145,9 +383,32 @@ namespace LLAP {
 		void cleanup_program();
 		void loop_program();
 
+		// Allocation guard
+		static const uint64_t MAX_ALLOCATION_REPORTS = 10;
+		uint64_t allocating_frames = 0;
+		void check_frame_allocations(uint64_t frame, const AllocationCounts& before);
+
 		virtual void init() = 0;
 		virtual void loop() = 0;
 		virtual void cleanup() = 0;
+		virtual void on_memory_pressure(uint32_t /*heap*/, const MemoryStats& /*stats*/) {}
+
+	protected:
+		// Frames are identified by the graphics timeline value they signal. Values
+		// increase monotonically, other graphics submissions take values too.
+		uint64_t submitted_frame() const;
+		uint64_t completed_frame();
+		void wait_for_frame(uint64_t frame);
+
+		// Submits to a queue and returns the timeline value signalled on completion,
+		// callable from any thread
+		uint64_t submit(QUEUE_TYPE type, VkCommandBuffer command_buffer,
+			const TimelineWait* waits = nullptr, uint32_t wait_count = 0);
+		void wait_queue(QUEUE_TYPE type, uint64_t value);
+		uint32_t queue_family(QUEUE_TYPE type);
+		VkCommandPool queue_command_pool(QUEUE_TYPE type);
+		VkDevice get_device() const;
+		const Capabilities& get_capabilities() const;
 
 	public:
 		void run();
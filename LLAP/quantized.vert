@@ -0,0 +1,26 @@
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "vertex_decode.glsl"
+
+// Meshes written by quantize_mesh() with its default attribute locations
+layout(location = 0) in vec4 in_position;
+layout(location = 1) in vec2 in_normal;
+
+layout(set = 0, binding = 0) uniform Frame {
+	mat4 transform;
+} frame;
+
+// Pushed by Program for every draw
+layout(push_constant) uniform Mesh {
+	vec3 position_offset;
+	vec3 position_scale;
+} mesh;
+
+layout(location = 0) out vec3 frag_color;
+
+void main() {
+	vec3 position = decode_position(in_position, mesh.position_offset, mesh.position_scale);
+	gl_Position = frame.transform * vec4(position, 1.0);
+	frag_color = decode_direction(in_normal) * 0.5 + 0.5;
+}
\ No newline at end of file
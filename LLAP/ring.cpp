@@ -0,0 +1,86 @@
+#include "ring.h"
+
+#include <algorithm>
+#include <string>
+
+namespace LLAP {
+
+	static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void FrameRing::init(VkDevice device, Allocator* allocator, const DeviceSnapshot& snapshot,
+		VkDeviceSize frame_size, uint32_t frame_count)
+	{
+		this->device = device;
+		this->allocator = allocator;
+
+		const VkPhysicalDeviceLimits& limits = snapshot.properties.limits;
+		uniform_alignment = std::max<VkDeviceSize>(limits.minUniformBufferOffsetAlignment, 1);
+		storage_alignment = std::max<VkDeviceSize>(limits.minStorageBufferOffsetAlignment, 1);
+
+		// Every partition starts aligned for any kind of slice
+		VkDeviceSize alignment = std::max({ uniform_alignment, storage_alignment, limits.nonCoherentAtomSize });
+		partition_size = align_up(frame_size, alignment);
+
+		buffer = create_buffer(device, *allocator, partition_size * frame_count,
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MEMORY_DYNAMIC);
+
+		begin = 0;
+		head = 0;
+	}
+
+	void FrameRing::cleanup() {
+		if (buffer.buffer != VK_NULL_HANDLE) {
+			destroy_buffer(device, *allocator, buffer);
+		}
+	}
+
+	void FrameRing::begin_frame(uint32_t frame) {
+		begin = frame_offset(frame);
+		head = begin;
+	}
+
+	RingSlice FrameRing::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+		VkDeviceSize offset = align_up(head, std::max<VkDeviceSize>(alignment, 1));
+		if (offset + size > begin + partition_size) {
+			log("Frame ring out of space, " + std::to_string(size) + " bytes requested with " +
+				std::to_string(begin + partition_size - head) + " left", ERROR);
+		}
+		head = offset + size;
+
+		RingSlice slice;
+		slice.buffer = buffer.buffer;
+		slice.offset = offset;
+		slice.data = static_cast<char*>(buffer.allocation.mapped) + offset;
+		return slice;
+	}
+
+	RingSlice FrameRing::allocate_uniform(VkDeviceSize size) {
+		return allocate(size, uniform_alignment);
+	}
+
+	RingSlice FrameRing::allocate_storage(VkDeviceSize size) {
+		return allocate(size, storage_alignment);
+	}
+
+	VkBuffer FrameRing::get_buffer() const {
+		return buffer.buffer;
+	}
+
+	VkDeviceSize FrameRing::frame_size() const {
+		return partition_size;
+	}
+
+	VkDeviceSize FrameRing::frame_offset(uint32_t frame) const {
+		return partition_size * frame;
+	}
+
+	VkDeviceSize FrameRing::used() const {
+		return head - begin;
+	}
+
+}
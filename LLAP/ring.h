@@ -0,0 +1,62 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+
+#include "debug.h"
+#include "allocator.h"
+#include "buffer.h"
+
+namespace LLAP {
+
+	struct RingSlice {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0; // Offset into buffer, also the dynamic offset to bind
+		void* data = nullptr; // Mapped pointer to write through
+	};
+
+	// Linear allocator over one persistently mapped buffer, split into a partition
+	// per frame in flight. A frame allocates by bumping an offset and gives all of
+	// it back at once when its partition comes round again, which the caller only
+	// does after the frame that last used it has completed.
+	class FrameRing {
+	public:
+		void init(VkDevice device, Allocator* allocator, const DeviceSnapshot& snapshot,
+			VkDeviceSize frame_size, uint32_t frame_count);
+		void cleanup();
+
+		// Resets the partition of frame, none of its slices may still be in use
+		void begin_frame(uint32_t frame);
+
+		RingSlice allocate(VkDeviceSize size, VkDeviceSize alignment);
+		RingSlice allocate_uniform(VkDeviceSize size);
+		RingSlice allocate_storage(VkDeviceSize size);
+
+		template<typename T>
+		RingSlice push(const T& value, VkDeviceSize alignment = alignof(T)) {
+			RingSlice slice = allocate(sizeof(T), alignment);
+			std::memcpy(slice.data, &value, sizeof(T));
+			return slice;
+		}
+
+		VkBuffer get_buffer() const;
+		VkDeviceSize frame_size() const;
+		VkDeviceSize frame_offset(uint32_t frame) const; // Where the partition of frame starts
+		VkDeviceSize used() const; // Bytes allocated by the current frame
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		Allocator* allocator = nullptr;
+		Buffer buffer;
+
+		VkDeviceSize partition_size = 0;
+		VkDeviceSize uniform_alignment = 1;
+		VkDeviceSize storage_alignment = 1;
+
+		VkDeviceSize begin = 0; // Partition of the current frame
+		VkDeviceSize head = 0;
+	};
+
+}
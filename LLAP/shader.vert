@@ -1,20 +1,15 @@
 #version 450
 
-vec2 positions[3] = vec2[](
-	vec2(0.0, -0.5),
-	vec2(0.5, 0.5),
-	vec2(-0.5, 0.5)
-);
+layout(location = 0) in vec2 in_position;
+layout(location = 1) in vec3 in_color;
 
-vec3 colors[3] = vec3[](
-	vec3(1.0, 0.0, 0.0),
-	vec3(0.0, 1.0, 0.0),
-	vec3(0.0, 0.0, 1.0)
-);
+layout(set = 0, binding = 0) uniform Frame {
+	mat4 transform;
+} frame;
 
 layout(location = 0) out vec3 frag_color;
 
 void main() {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	frag_color = colors[gl_VertexIndex];
+	gl_Position = frame.transform * vec4(in_position, 0.0, 1.0);
+	frag_color = in_color;
 }
\ No newline at end of file
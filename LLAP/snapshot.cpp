@@ -0,0 +1,292 @@
+#include "snapshot.h"
+#include "capabilities.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace LLAP {
+
+	static const uint32_t SNAPSHOT_MAGIC = 0x50414c4c; // "LLAP"
+	static const uint32_t SNAPSHOT_VERSION = 2;
+	// Far above any driver, a larger count means the file is corrupt
+	static const uint32_t MAX_SNAPSHOT_QUEUE_FAMILIES = 64;
+	static const uint32_t MAX_SNAPSHOT_EXTENSIONS = 4096;
+
+	bool DeviceSnapshot::has_extension(const std::string& name) const {
+		return std::binary_search(extensions.begin(), extensions.end(), name);
+	}
+
+	template<typename T>
+	static void write_pod(std::ofstream& file, const T& value) {
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	static bool read_pod(std::ifstream& file, T& value) {
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	static std::string snapshot_path(const std::string& cache_directory, const VkPhysicalDeviceProperties& properties) {
+		return cache_directory + "/device_" +
+			std::to_string(properties.vendorID) + "_" +
+			std::to_string(properties.deviceID) + ".bin";
+	}
+
+	// The driver version and pipeline cache UUID change with every driver build
+	static bool same_driver(const VkPhysicalDeviceProperties& a, const VkPhysicalDeviceProperties& b) {
+		return a.vendorID == b.vendorID &&
+			a.deviceID == b.deviceID &&
+			a.driverVersion == b.driverVersion &&
+			a.apiVersion == b.apiVersion &&
+			std::memcmp(a.pipelineCacheUUID, b.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	static bool load_snapshot(const std::string& path, DeviceSnapshot& snapshot) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		uint32_t magic = 0, version = 0;
+		VkPhysicalDeviceProperties cached_properties;
+		if (!read_pod(file, magic) || !read_pod(file, version) || !read_pod(file, cached_properties) ||
+			magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION ||
+			!same_driver(cached_properties, snapshot.properties))
+		{
+			return false;
+		}
+
+		uint32_t queue_family_count = 0, extension_count = 0;
+		if (!read_pod(file, snapshot.memory_properties) ||
+			!read_pod(file, snapshot.features) ||
+			!read_pod(file, snapshot.storage_16bit_features) ||
+			!read_pod(file, snapshot.timeline_semaphore_features) ||
+			!read_pod(file, snapshot.descriptor_indexing_features) ||
+			!read_pod(file, snapshot.buffer_device_address_features) ||
+			!read_pod(file, snapshot.descriptor_indexing_properties) ||
+			!read_pod(file, queue_family_count) || queue_family_count > MAX_SNAPSHOT_QUEUE_FAMILIES)
+		{
+			return false;
+		}
+
+		snapshot.queue_families.resize(queue_family_count);
+		for (auto& queue_family : snapshot.queue_families) {
+			if (!read_pod(file, queue_family)) {
+				return false;
+			}
+		}
+
+		if (!read_pod(file, extension_count) || extension_count > MAX_SNAPSHOT_EXTENSIONS) {
+			return false;
+		}
+
+		snapshot.extensions.resize(extension_count);
+		for (auto& extension : snapshot.extensions) {
+			uint32_t length = 0;
+			if (!read_pod(file, length) || length > VK_MAX_EXTENSION_NAME_SIZE) {
+				return false;
+			}
+			extension.resize(length);
+			if (!file.read(&extension[0], length)) {
+				return false;
+			}
+		}
+
+		snapshot.storage_16bit_features.pNext = nullptr;
+		snapshot.timeline_semaphore_features.pNext = nullptr;
+		snapshot.descriptor_indexing_features.pNext = nullptr;
+		snapshot.buffer_device_address_features.pNext = nullptr;
+		snapshot.descriptor_indexing_properties.pNext = nullptr;
+
+		return true;
+	}
+
+	static void save_snapshot(const std::string& path, const DeviceSnapshot& snapshot) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			log("Couldn't write device snapshot " + path, WARNING);
+			return;
+		}
+
+		write_pod(file, SNAPSHOT_MAGIC);
+		write_pod(file, SNAPSHOT_VERSION);
+		write_pod(file, snapshot.properties);
+		write_pod(file, snapshot.memory_properties);
+		write_pod(file, snapshot.features);
+		write_pod(file, snapshot.storage_16bit_features);
+		write_pod(file, snapshot.timeline_semaphore_features);
+		write_pod(file, snapshot.descriptor_indexing_features);
+		write_pod(file, snapshot.buffer_device_address_features);
+		write_pod(file, snapshot.descriptor_indexing_properties);
+
+		write_pod(file, static_cast<uint32_t>(snapshot.queue_families.size()));
+		for (const auto& queue_family : snapshot.queue_families) {
+			write_pod(file, queue_family);
+		}
+
+		write_pod(file, static_cast<uint32_t>(snapshot.extensions.size()));
+		for (const auto& extension : snapshot.extensions) {
+			write_pod(file, static_cast<uint32_t>(extension.size()));
+			file.write(extension.data(), extension.size());
+		}
+	}
+
+	static void query_device(DeviceSnapshot& snapshot) {
+		VkPhysicalDevice device = snapshot.device;
+
+		vkGetPhysicalDeviceMemoryProperties(device, &snapshot.memory_properties);
+
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, nullptr);
+		snapshot.queue_families.resize(queue_family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, snapshot.queue_families.data());
+
+		uint32_t extension_count = 0;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+		snapshot.extensions.clear();
+		for (const auto& extension : available_extensions) {
+			snapshot.extensions.push_back(extension.extensionName);
+		}
+		std::sort(snapshot.extensions.begin(), snapshot.extensions.end());
+
+		// Only chain structures the device knows about
+		bool vulkan_1_2 = snapshot.properties.apiVersion >= VK_API_VERSION_1_2;
+		bool descriptor_indexing = vulkan_1_2 || snapshot.has_extension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		FeatureChain supported;
+		supported.link(
+			snapshot.properties.apiVersion >= VK_API_VERSION_1_1 || snapshot.has_extension(VK_KHR_16BIT_STORAGE_EXTENSION_NAME),
+			descriptor_indexing,
+			vulkan_1_2 || snapshot.has_extension(VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME));
+		vkGetPhysicalDeviceFeatures2(device, &supported.features);
+
+		snapshot.features = supported.features.features;
+		snapshot.storage_16bit_features = supported.storage_16bit;
+		snapshot.timeline_semaphore_features = supported.timeline_semaphore;
+		snapshot.descriptor_indexing_features = supported.descriptor_indexing;
+		snapshot.buffer_device_address_features = supported.buffer_device_address;
+		snapshot.storage_16bit_features.pNext = nullptr;
+		snapshot.timeline_semaphore_features.pNext = nullptr;
+		snapshot.descriptor_indexing_features.pNext = nullptr;
+		snapshot.buffer_device_address_features.pNext = nullptr;
+
+		snapshot.descriptor_indexing_properties = {};
+		if (descriptor_indexing) {
+			snapshot.descriptor_indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+
+			VkPhysicalDeviceProperties2 properties{};
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties.pNext = &snapshot.descriptor_indexing_properties;
+			vkGetPhysicalDeviceProperties2(device, &properties);
+			snapshot.descriptor_indexing_properties.pNext = nullptr;
+		}
+	}
+
+	DeviceSnapshot build_snapshot(VkPhysicalDevice device, VkSurfaceKHR surface, const std::string& cache_directory) {
+		DeviceSnapshot snapshot;
+		snapshot.device = device;
+
+		// Needed for the cache key either way
+		vkGetPhysicalDeviceProperties(device, &snapshot.properties);
+
+		if (cache_directory.empty()) {
+			query_device(snapshot);
+		}
+		else {
+			std::string path = snapshot_path(cache_directory, snapshot.properties);
+			if (load_snapshot(path, snapshot)) {
+				log("Loaded device snapshot " + path);
+			}
+			else {
+				query_device(snapshot);
+				save_snapshot(path, snapshot);
+			}
+		}
+
+		uint32_t queue_family_count = static_cast<uint32_t>(snapshot.queue_families.size());
+		snapshot.present_support.resize(queue_family_count);
+		for (uint32_t i = 0; i < queue_family_count; i++) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &snapshot.present_support[i]);
+		}
+
+		snapshot.indices = find_queue_families(snapshot.queue_families, snapshot.present_support);
+		snapshot.swap_chain_support = query_swap_chain_support(device, surface);
+
+		return snapshot;
+	}
+
+	SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device, VkSurfaceKHR surface)
+	{
+		SwapChainSupportDetails details;
+
+		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+		uint32_t format_count;
+		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, nullptr);
+
+		if (format_count > 0) {
+			details.formats.resize(format_count);
+			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, details.formats.data());
+		}
+
+		uint32_t present_mode_count;
+		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, nullptr);
+
+		if (present_mode_count > 0) {
+			details.present_modes.resize(present_mode_count);
+			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, details.present_modes.data());
+		}
+		
+		return details;
+	}
+
+	QueueFamilyIndices find_queue_families(const std::vector<VkQueueFamilyProperties>& queue_families,
+		const std::vector<VkBool32>& present_support)
+	{
+		QueueFamilyIndices indices;
+
+		for (uint32_t i = 0; i < static_cast<uint32_t>(queue_families.size()); i++) {
+			VkQueueFlags flags = queue_families[i].queueFlags;
+
+			// Prefer a graphics family that can also present
+			if (flags & VK_QUEUE_GRAPHICS_BIT) {
+				if (!indices.graphics_family.has_value() ||
+					(present_support[i] && indices.graphics_family != indices.present_family))
+				{
+					indices.graphics_family = i;
+				}
+			}
+
+			if (present_support[i] && (!indices.present_family.has_value() || indices.graphics_family == i)) {
+				indices.present_family = i;
+			}
+
+			// Dedicated families have no graphics (compute) or no graphics and compute (transfer)
+			if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) &&
+				!indices.compute_family.has_value())
+			{
+				indices.compute_family = i;
+			}
+
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+				!indices.transfer_family.has_value())
+			{
+				indices.transfer_family = i;
+			}
+		}
+
+		if (!indices.compute_family.has_value()) {
+			indices.compute_family = indices.graphics_family;
+		}
+
+		if (!indices.transfer_family.has_value()) {
+			indices.transfer_family = indices.compute_family;
+		}
+
+		return indices;
+	}
+
+}
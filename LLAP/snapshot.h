@@ -0,0 +1,60 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <optional>
+
+#include "debug.h"
+
+namespace LLAP {
+
+	struct QueueFamilyIndices {
+		std::optional<uint32_t> graphics_family;
+		std::optional<uint32_t> present_family;
+		std::optional<uint32_t> compute_family; // Falls back to graphics_family
+		std::optional<uint32_t> transfer_family; // Falls back to compute_family
+	};
+
+	struct SwapChainSupportDetails {
+		VkSurfaceCapabilitiesKHR capabilities;
+		std::vector<VkSurfaceFormatKHR> formats;
+		std::vector<VkPresentModeKHR> present_modes;
+	};
+
+	// Everything device selection and swap chain setup need to know about a
+	// physical device, queried once. The extension feature structures are
+	// stored unchained (pNext is null).
+	struct DeviceSnapshot {
+		VkPhysicalDevice device = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties properties;
+		VkPhysicalDeviceMemoryProperties memory_properties;
+		VkPhysicalDeviceFeatures features;
+		VkPhysicalDevice16BitStorageFeatures storage_16bit_features;
+		VkPhysicalDeviceTimelineSemaphoreFeatures timeline_semaphore_features;
+		VkPhysicalDeviceDescriptorIndexingFeatures descriptor_indexing_features;
+		VkPhysicalDeviceBufferDeviceAddressFeatures buffer_device_address_features;
+		VkPhysicalDeviceDescriptorIndexingProperties descriptor_indexing_properties; // Zero without descriptor indexing
+		std::vector<VkQueueFamilyProperties> queue_families;
+		std::vector<std::string> extensions; // Sorted
+
+		// Surface dependent, never persisted
+		std::vector<VkBool32> present_support;
+		QueueFamilyIndices indices;
+		SwapChainSupportDetails swap_chain_support;
+
+		bool has_extension(const std::string& name) const;
+	};
+
+	// Builds the snapshot for device against surface. When cache_directory is
+	// not empty the device part is read from, or written to, a file keyed by
+	// vendor, device and driver version so later runs skip those queries.
+	DeviceSnapshot build_snapshot(VkPhysicalDevice device, VkSurfaceKHR surface, const std::string& cache_directory = "");
+
+	SwapChainSupportDetails query_swap_chain_support(VkPhysicalDevice device, VkSurfaceKHR surface);
+	QueueFamilyIndices find_queue_families(const std::vector<VkQueueFamilyProperties>& queue_families,
+		const std::vector<VkBool32>& present_support);
+
+}
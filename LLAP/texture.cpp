@@ -0,0 +1,313 @@
+#include "texture.h"
+
+#include <algorithm>
+
+namespace LLAP {
+
+	uint32_t TextureData::level_count() const {
+		return static_cast<uint32_t>(level_sizes.size());
+	}
+
+	const char* TextureData::level_data(uint32_t level) const {
+		return (file != nullptr ? file->data() : bytes.data()) + level_offsets[level];
+	}
+
+	void TextureStreamer::init(VkDevice device, Allocator* allocator, Uploader* uploader, BindlessTable* bindless,
+		const std::vector<uint32_t>& families, uint32_t thread_count, float max_anisotropy)
+	{
+		this->device = device;
+		this->allocator = allocator;
+		this->uploader = uploader;
+		this->bindless = bindless;
+		this->families = families;
+
+		VkSamplerCreateInfo sampler_info{};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_LINEAR;
+		sampler_info.minFilter = VK_FILTER_LINEAR;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		sampler_info.anisotropyEnable = max_anisotropy > 0.0f ? VK_TRUE : VK_FALSE;
+		sampler_info.maxAnisotropy = max_anisotropy;
+		sampler_info.minLod = 0.0f;
+		sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(device, &sampler_info, host_callbacks(HOST_SCOPE_DEVICE), &sampler) != VK_SUCCESS) {
+			log("Failed to create texture sampler", ERROR);
+		}
+
+		if (bindless != nullptr) {
+			sampler_index = bindless->add_sampler(sampler);
+		}
+
+		workers.start(thread_count, [this] { stream(); });
+	}
+
+	void TextureStreamer::cleanup() {
+		workers.stop();
+		loaded.clear();
+
+		for (auto& texture : textures) {
+			if (texture.image.image != VK_NULL_HANDLE) {
+				destroy_image(device, *allocator, texture.image);
+			}
+			if (texture.pending.image != VK_NULL_HANDLE) {
+				destroy_image(device, *allocator, texture.pending);
+			}
+		}
+		textures.clear();
+
+		for (auto& entry : retired) {
+			destroy_image(device, *allocator, entry.image);
+		}
+		retired.clear();
+		evicting = 0;
+
+		vkDestroySampler(device, sampler, host_callbacks(HOST_SCOPE_DEVICE));
+		sampler = VK_NULL_HANDLE;
+	}
+
+	void TextureStreamer::stream() {
+		Job job;
+		while (workers.pop(job)) {
+			// A texture that fails to load stays not ready rather than ending the program
+			TextureData data;
+			try {
+				data = job.loader(job.path);
+			}
+			catch (const std::exception& e) {
+				log("Failed to load texture " + job.path + ": " + e.what(), WARNING);
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			loaded.emplace_back(job.texture, std::move(data));
+		}
+	}
+
+	uint32_t TextureStreamer::load(const std::string& path, TextureLoader loader, float priority) {
+		uint32_t id = static_cast<uint32_t>(textures.size());
+		textures.emplace_back();
+		textures.back().priority = priority;
+
+		workers.push({ id, path, std::move(loader) });
+
+		return id;
+	}
+
+	uint32_t TextureStreamer::load(TextureData data, float priority) {
+		uint32_t id = static_cast<uint32_t>(textures.size());
+		textures.emplace_back();
+		textures.back().priority = priority;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		loaded.emplace_back(id, std::move(data));
+
+		return id;
+	}
+
+	void TextureStreamer::set_priority(uint32_t texture, float priority, uint32_t finest_level) {
+		textures[texture].priority = priority;
+		textures[texture].finest_level = finest_level;
+	}
+
+	VkDeviceSize TextureStreamer::upload_size(const Texture& texture, uint32_t level) const {
+		VkDeviceSize size = 0;
+		for (uint32_t i = level; i < texture.data.level_count(); i++) {
+			size += texture.data.level_sizes[i];
+		}
+		return size;
+	}
+
+	void TextureStreamer::make_resident(uint32_t id, TextureData& data) {
+		Texture& texture = textures[id];
+		uint32_t level_count = data.level_count();
+		if (level_count == 0) {
+			log("Texture has no levels", WARNING);
+			return;
+		}
+
+		texture.data = std::move(data);
+		texture.loaded = true;
+
+		// Coarsest levels first, they are small enough to arrive within a frame or two
+		texture.base_level = level_count - 1;
+		while (texture.base_level > 0) {
+			VkExtent2D extent = mip_extent(texture.data.extent, texture.base_level - 1);
+			if (std::max(extent.width, extent.height) > BASE_LEVEL_SIZE) {
+				break;
+			}
+			texture.base_level--;
+		}
+
+		start_upload(texture, texture.base_level);
+	}
+
+	void TextureStreamer::start_upload(Texture& texture, uint32_t level) {
+		const TextureData& data = texture.data;
+		uint32_t level_count = data.level_count() - level;
+
+		texture.pending = create_image(device, *allocator, mip_extent(data.extent, level), level_count, data.format,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, MEMORY_TEXTURE, families, data.layer_count);
+		texture.pending_level = level;
+
+		// Every level is written, the uploader moves them all to SHADER_READ_ONLY_OPTIMAL
+		for (uint32_t i = 0; i < level_count; i++) {
+			texture.pending_upload = uploader->upload_image(texture.pending.image, i, mip_extent(data.extent, level + i),
+				data.level_data(level + i), data.level_sizes[level + i], data.layer_count);
+		}
+	}
+
+	bool TextureStreamer::update(VkDeviceSize max_bytes, uint64_t submitted_value, uint64_t completed_value) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::swap(loaded, arrived);
+		}
+		for (auto& entry : arrived) {
+			make_resident(entry.first, entry.second);
+		}
+		arrived.clear();
+
+		// Swap in textures whose upload completed, frames up to submitted_value may still read the old image
+		bool swapped = false;
+		for (auto& texture : textures) {
+			if (texture.pending_level == NO_LEVEL ||
+				texture.pending_upload.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				continue;
+			}
+
+			if (texture.image.image != VK_NULL_HANDLE) {
+				retired.push_back({ texture.image, submitted_value, texture.pending_release });
+			}
+			if (bindless != nullptr && texture.index != BindlessTable::INVALID_INDEX) {
+				bindless->remove(BINDLESS_TEXTURES, texture.index, submitted_value);
+			}
+
+			texture.image = texture.pending;
+			texture.resident_level = texture.pending_level;
+			texture.pending = Image{};
+			texture.pending_level = NO_LEVEL;
+			texture.pending_release = 0;
+			if (bindless != nullptr) {
+				texture.index = bindless->add_texture(texture.image.view);
+			}
+			swapped = true;
+		}
+
+		for (auto& entry : retired) {
+			if (entry.value <= completed_value) {
+				evicting -= entry.release;
+				destroy_image(device, *allocator, entry.image);
+			}
+		}
+		retired.erase(std::remove_if(retired.begin(), retired.end(),
+			[](const Retired& entry) { return entry.image.image == VK_NULL_HANDLE; }), retired.end());
+
+		if (max_bytes == 0) {
+			return swapped;
+		}
+
+		order.clear();
+		for (uint32_t i = 0; i < textures.size(); i++) {
+			const Texture& texture = textures[i];
+			if (texture.resident_level != NO_LEVEL && texture.pending_level == NO_LEVEL &&
+				texture.resident_level > texture.finest_level)
+			{
+				order.push_back(i);
+			}
+		}
+		std::sort(order.begin(), order.end(),
+			[&](uint32_t a, uint32_t b) { return textures[a].priority > textures[b].priority; });
+
+		// One level per texture and frame, at least one upload so large levels make progress
+		VkDeviceSize queued = 0;
+		for (uint32_t i : order) {
+			Texture& texture = textures[i];
+			VkDeviceSize size = upload_size(texture, texture.resident_level - 1);
+			if (queued > 0 && queued + size > max_bytes) {
+				break;
+			}
+
+			start_upload(texture, texture.resident_level - 1);
+			queued += size;
+		}
+		return swapped;
+	}
+
+	VkDeviceSize TextureStreamer::evict(VkDeviceSize bytes) {
+		if (evicting > 0) {
+			return 0;
+		}
+
+		order.clear();
+		for (uint32_t i = 0; i < textures.size(); i++) {
+			const Texture& texture = textures[i];
+			if (texture.resident_level != NO_LEVEL && texture.pending_level == NO_LEVEL &&
+				texture.resident_level < texture.base_level)
+			{
+				order.push_back(i);
+			}
+		}
+		std::sort(order.begin(), order.end(),
+			[&](uint32_t a, uint32_t b) { return textures[a].priority < textures[b].priority; });
+
+		VkDeviceSize released = 0;
+		for (uint32_t i : order) {
+			if (released >= bytes) {
+				break;
+			}
+
+			// The smaller copy is allocated before the old image is freed
+			Texture& texture = textures[i];
+			texture.finest_level = texture.resident_level + 1;
+			start_upload(texture, texture.finest_level);
+			if (texture.image.allocation.size > texture.pending.allocation.size) {
+				texture.pending_release = texture.image.allocation.size - texture.pending.allocation.size;
+				released += texture.pending_release;
+			}
+		}
+
+		evicting = released;
+		return released;
+	}
+
+	VkDeviceSize TextureStreamer::evicting_bytes() const {
+		return evicting;
+	}
+
+	bool TextureStreamer::is_ready(uint32_t texture) const {
+		return textures[texture].resident_level != NO_LEVEL;
+	}
+
+	uint32_t TextureStreamer::get_index(uint32_t texture) const {
+		return textures[texture].index;
+	}
+
+	VkImageView TextureStreamer::get_view(uint32_t texture) const {
+		return textures[texture].image.view;
+	}
+
+	uint32_t TextureStreamer::resident_level(uint32_t texture) const {
+		return textures[texture].resident_level;
+	}
+
+	VkSampler TextureStreamer::get_sampler() const {
+		return sampler;
+	}
+
+	uint32_t TextureStreamer::get_sampler_index() const {
+		return sampler_index;
+	}
+
+	VkDeviceSize TextureStreamer::resident_bytes() const {
+		VkDeviceSize bytes = 0;
+		for (const auto& texture : textures) {
+			bytes += texture.image.allocation.size;
+		}
+		return bytes;
+	}
+
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <memory>
+
+#include "debug.h"
+#include "io.h"
+#include "allocator.h"
+#include "image.h"
+#include "upload.h"
+#include "worker_pool.h"
+#include "bindless.h"
+
+namespace LLAP {
+
+	// A texture's mip chain in CPU memory, level 0 is the finest. Every level is
+	// tightly packed texels or compressed blocks of each layer in turn. Level
+	// offsets point into file when it's set, otherwise into bytes.
+	struct TextureData {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = { 0, 0 };
+		uint32_t layer_count = 1;
+		std::vector<VkDeviceSize> level_offsets;
+		std::vector<VkDeviceSize> level_sizes;
+		std::vector<char> bytes;
+		std::shared_ptr<const MappedFile> file;
+
+		uint32_t level_count() const;
+		const char* level_data(uint32_t level) const;
+	};
+
+	// Reads a texture file, called on a streaming thread
+	typedef std::function<TextureData(const std::string& path)> TextureLoader;
+
+	// Loads textures on background threads and makes them resident coarsest
+	// levels first. Finer levels stream in by priority within a per-frame byte
+	// budget and the finest are evicted again under memory pressure.
+	//
+	// Without sparse residency a texture's level count can't change, so every
+	// step uploads a new image holding the resident levels and retires the old
+	// one. The coarser levels add a third of the new level's size at most. The
+	// CPU copy of each texture is kept to make that possible, mapped files keep
+	// it in the page cache rather than the heap.
+	//
+	// Those images come from the allocator's optimal tiling blocks, which the
+	// Defragmenter never empties since it only relocates buffers. Holes left by
+	// retired images are only reused by later allocations that fit them.
+	class TextureStreamer {
+	public:
+		static const uint32_t INVALID_TEXTURE = UINT32_MAX;
+
+		// bindless may be nullptr, textures then only have views. max_anisotropy
+		// of 0 disables anisotropic filtering.
+		void init(VkDevice device, Allocator* allocator, Uploader* uploader, BindlessTable* bindless,
+			const std::vector<uint32_t>& families, uint32_t thread_count, float max_anisotropy);
+		// The device must be idle
+		void cleanup();
+
+		// Returns the texture right away, it becomes ready once its coarse levels
+		// arrived. Like every other method, only call it from the render thread.
+		uint32_t load(const std::string& path, TextureLoader loader, float priority = 0.0f);
+		uint32_t load(TextureData data, float priority = 0.0f);
+
+		// Higher priorities stream first and are evicted last, e.g. the inverse
+		// distance to the camera. finest_level keeps the texture coarser, e.g.
+		// when it only covers a few pixels.
+		void set_priority(uint32_t texture, float priority, uint32_t finest_level = 0);
+
+		// Once per frame. Swaps in textures whose uploads completed, then queues the
+		// next finer level of the highest priority textures until max_bytes.
+		// submitted_value is the graphics timeline value of the last submitted frame.
+		// Returns true when textures were swapped in, the next frame must then wait
+		// on the transfer queue for their uploads to be visible.
+		bool update(VkDeviceSize max_bytes, uint64_t submitted_value, uint64_t completed_value);
+
+		// Drops the finest level of the lowest priority textures until about bytes
+		// are released, never below their initial levels. They stay coarser until
+		// set_priority asks for finer levels again. Returns the bytes that will be
+		// released, by allocation size. Does nothing while earlier evictions are
+		// still in flight, their bytes are only released once the old images are
+		// no longer used.
+		VkDeviceSize evict(VkDeviceSize bytes);
+		VkDeviceSize evicting_bytes() const; // Promised by evictions in flight
+
+		bool is_ready(uint32_t texture) const;
+		// Bindless texture index, it changes whenever levels stream in or out so
+		// read it every frame. BindlessTable::INVALID_INDEX until ready.
+		uint32_t get_index(uint32_t texture) const;
+		VkImageView get_view(uint32_t texture) const;
+		uint32_t resident_level(uint32_t texture) const;
+
+		VkSampler get_sampler() const;
+		uint32_t get_sampler_index() const;
+		VkDeviceSize resident_bytes() const;
+
+	private:
+		// Textures become ready with the levels no larger than this
+		static const uint32_t BASE_LEVEL_SIZE = 128;
+		static const uint32_t NO_LEVEL = UINT32_MAX;
+
+		struct Texture {
+			TextureData data;
+			bool loaded = false;
+			float priority = 0.0f;
+			uint32_t finest_level = 0;
+			uint32_t base_level = 0;
+
+			Image image; // Levels [resident_level, level_count) of data
+			uint32_t resident_level = NO_LEVEL;
+			uint32_t index = BindlessTable::INVALID_INDEX;
+
+			// Replacement being uploaded, the last upload completes last
+			Image pending;
+			uint32_t pending_level = NO_LEVEL;
+			std::future<void> pending_upload;
+			VkDeviceSize pending_release = 0; // Bytes swapping in pending frees, for evictions
+		};
+
+		struct Retired {
+			Image image;
+			uint64_t value;
+			VkDeviceSize release = 0;
+		};
+
+		struct Job {
+			uint32_t texture;
+			std::string path;
+			TextureLoader loader;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		Allocator* allocator = nullptr;
+		Uploader* uploader = nullptr;
+		BindlessTable* bindless = nullptr;
+		std::vector<uint32_t> families;
+		VkSampler sampler = VK_NULL_HANDLE;
+		uint32_t sampler_index = BindlessTable::INVALID_INDEX;
+
+		std::deque<Texture> textures;
+		std::vector<Retired> retired;
+		VkDeviceSize evicting = 0;
+		std::vector<uint32_t> order; // Reused every frame
+
+		WorkerPool<Job> workers;
+		// Shared with the streaming threads
+		std::mutex mutex;
+		std::vector<std::pair<uint32_t, TextureData>> loaded;
+		std::vector<std::pair<uint32_t, TextureData>> arrived; // Swapped with loaded
+
+		void stream();
+		void make_resident(uint32_t id, TextureData& data);
+		void start_upload(Texture& texture, uint32_t level);
+		VkDeviceSize upload_size(const Texture& texture, uint32_t level) const;
+	};
+
+}
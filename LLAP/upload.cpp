@@ -0,0 +1,291 @@
+#include "upload.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LLAP {
+
+	void Uploader::init(VkDevice device, Allocator* allocator, VkCommandPool command_pool) {
+		this->device = device;
+		this->allocator = allocator;
+		this->command_pool = command_pool;
+	}
+
+	void Uploader::cleanup() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (auto& batch : batches) {
+			vkFreeCommandBuffers(device, command_pool, 1, &batch.command_buffer);
+		}
+		batches.clear();
+		queue.clear();
+
+		for (auto& page : pages) {
+			if (page.buffer.buffer != VK_NULL_HANDLE) {
+				destroy_buffer(device, *allocator, page.buffer);
+			}
+		}
+		pages.clear();
+		free_pages.clear();
+		open_page = UINT32_MAX;
+	}
+
+	uint32_t Uploader::create_page(VkDeviceSize size, bool dedicated) {
+		Page page;
+		page.buffer = create_buffer(device, *allocator, size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MEMORY_STAGING);
+		page.dedicated = dedicated;
+
+		for (uint32_t i = 0; i < pages.size(); i++) {
+			if (pages[i].buffer.buffer == VK_NULL_HANDLE) {
+				pages[i] = page;
+				return i;
+			}
+		}
+
+		pages.push_back(page);
+		return static_cast<uint32_t>(pages.size() - 1);
+	}
+
+	std::future<void> Uploader::upload(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+		Request request;
+		request.dst = dst;
+		request.dst_offset = dst_offset;
+		request.size = size;
+		return queue_request(request, data);
+	}
+
+	std::future<void> Uploader::upload_image(VkImage dst, uint32_t mip_level, VkExtent2D extent, const void* data, VkDeviceSize size,
+		uint32_t layers)
+	{
+		Request request;
+		request.image = dst;
+		request.mip_level = mip_level;
+		request.extent = extent;
+		request.layers = layers;
+		request.size = size;
+		return queue_request(request, data);
+	}
+
+	std::future<void> Uploader::upload_image_region(VkImage dst, uint32_t mip_level, VkOffset2D offset, VkExtent2D extent,
+		const void* data, VkDeviceSize size)
+	{
+		Request request;
+		request.image = dst;
+		request.mip_level = mip_level;
+		request.offset = offset;
+		request.extent = extent;
+		request.in_place = true;
+		request.size = size;
+		return queue_request(request, data);
+	}
+
+	std::future<void> Uploader::queue_request(Request& request, const void* data) {
+		VkDeviceSize size = request.size;
+		std::future<void> future = request.promise.get_future();
+
+		if (size == 0) {
+			request.promise.set_value();
+			return future;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (size > PAGE_SIZE) {
+			request.page = create_page(size, true);
+			request.src_offset = 0;
+		}
+		else {
+			// Image copies need offsets aligned to the texel block, 16 bytes covers every format block
+			VkDeviceSize offset = open_page != UINT32_MAX ? (pages[open_page].head + 15) & ~VkDeviceSize(15) : 0;
+			if (open_page == UINT32_MAX || offset + size > PAGE_SIZE) {
+				if (free_pages.empty()) {
+					open_page = create_page(PAGE_SIZE, false);
+				}
+				else {
+					open_page = free_pages.back();
+					free_pages.pop_back();
+					pages[open_page].free = false;
+				}
+				offset = 0;
+			}
+			request.page = open_page;
+			request.src_offset = offset;
+		}
+
+		Page& page = pages[request.page];
+		std::memcpy(static_cast<char*>(page.buffer.allocation.mapped) + request.src_offset, data, static_cast<size_t>(size));
+		page.head = request.src_offset + size;
+		page.pending++;
+
+		queue.push_back(std::move(request));
+		return future;
+	}
+
+	VkCommandBuffer Uploader::record(VkDeviceSize max_bytes) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (queue.empty()) {
+			return VK_NULL_HANDLE;
+		}
+
+		Batch batch;
+
+		VkCommandBufferAllocateInfo alloc_info{};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandPool = command_pool;
+		alloc_info.commandBufferCount = 1;
+
+		if (vkAllocateCommandBuffers(device, &alloc_info, &batch.command_buffer) != VK_SUCCESS) {
+			log("Failed to allocate upload command buffer", ERROR);
+		}
+
+		VkCommandBufferBeginInfo begin_info{};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(batch.command_buffer, &begin_info);
+
+		VkDeviceSize recorded = 0;
+		while (!queue.empty() && (recorded == 0 || recorded + queue.front().size <= max_bytes)) {
+			Request& request = queue.front();
+
+			if (request.image != VK_NULL_HANDLE) {
+				record_image_copy(batch.command_buffer, request);
+			}
+			else {
+				VkBufferCopy region{};
+				region.srcOffset = request.src_offset;
+				region.dstOffset = request.dst_offset;
+				region.size = request.size;
+				vkCmdCopyBuffer(batch.command_buffer, pages[request.page].buffer.buffer, request.dst, 1, &region);
+			}
+
+			pages[request.page].pending--;
+			if (std::find(batch.pages.begin(), batch.pages.end(), request.page) == batch.pages.end()) {
+				batch.pages.push_back(request.page);
+			}
+			batch.promises.push_back(std::move(request.promise));
+			recorded += request.size;
+
+			queue.pop_front();
+		}
+
+		if (vkEndCommandBuffer(batch.command_buffer) != VK_SUCCESS) {
+			log("Failed to record upload command buffer", ERROR);
+		}
+
+		batches.push_back(std::move(batch));
+		return batches.back().command_buffer;
+	}
+
+	void Uploader::record_image_copy(VkCommandBuffer command_buffer, const Request& request) {
+		VkBufferImageCopy region{};
+		region.bufferOffset = request.src_offset;
+		region.bufferRowLength = 0; // Tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = request.mip_level;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = request.layers;
+		region.imageOffset = { request.offset.x, request.offset.y, 0 };
+		region.imageExtent = { request.extent.width, request.extent.height, 1 };
+
+		if (request.in_place) {
+			vkCmdCopyBufferToImage(command_buffer, pages[request.page].buffer.buffer, request.image,
+				VK_IMAGE_LAYOUT_GENERAL, 1, &region);
+			return;
+		}
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = request.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = request.mip_level;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = request.layers;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(command_buffer, pages[request.page].buffer.buffer, request.image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		// Made visible to the graphics queue by its wait on the transfer timeline
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	void Uploader::submitted(uint64_t value) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Batch& batch = batches.back();
+		batch.value = value;
+		for (uint32_t page : batch.pages) {
+			pages[page].value = value;
+		}
+	}
+
+	uint64_t Uploader::collect(uint64_t completed_value) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		uint64_t collected = 0;
+		for (auto& batch : batches) {
+			if (batch.value != 0 && batch.value <= completed_value) {
+				collected = std::max(collected, batch.value);
+				vkFreeCommandBuffers(device, command_pool, 1, &batch.command_buffer);
+				batch.command_buffer = VK_NULL_HANDLE;
+				for (auto& promise : batch.promises) {
+					promise.set_value();
+				}
+			}
+		}
+
+		batches.erase(std::remove_if(batches.begin(), batches.end(),
+			[](const Batch& batch) { return batch.command_buffer == VK_NULL_HANDLE; }), batches.end());
+
+		// Pages still read by an unsubmitted batch have an old value, skip those too
+		bool unsubmitted = !batches.empty() && batches.back().value == 0;
+		for (uint32_t i = 0; i < pages.size(); i++) {
+			Page& page = pages[i];
+			bool in_use = page.buffer.buffer == VK_NULL_HANDLE || page.free || page.pending > 0 ||
+				page.value > completed_value || i == open_page ||
+				(unsubmitted && std::find(batches.back().pages.begin(), batches.back().pages.end(), i) != batches.back().pages.end());
+			if (in_use) {
+				continue;
+			}
+
+			if (page.dedicated) {
+				destroy_buffer(device, *allocator, page.buffer);
+				page = Page{};
+			}
+			else {
+				page.head = 0;
+				page.free = true;
+				free_pages.push_back(i);
+			}
+		}
+		return collected;
+	}
+
+	bool Uploader::idle() const {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		return queue.empty() && batches.empty();
+	}
+
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <future>
+#include <mutex>
+
+#include "debug.h"
+#include "allocator.h"
+#include "buffer.h"
+
+namespace LLAP {
+
+	// Copies data into device local buffers through the transfer queue. Small
+	// uploads share staging pages, large ones get a staging buffer of their own.
+	// Any thread may queue uploads, the render thread records them in batches of
+	// a byte budget, submits them and collects them once the transfer timeline
+	// passed, which fulfils their futures and recycles the staging pages.
+	class Uploader {
+	public:
+		void init(VkDevice device, Allocator* allocator, VkCommandPool command_pool);
+		void cleanup();
+
+		// dst must be usable by the transfer queue family, and never be moved by the
+		// defragmenter. data is copied before this returns.
+		std::future<void> upload(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+
+		// Fills one mip level of a color image with tightly packed texels, layer
+		// after layer. The level is moved from any layout to SHADER_READ_ONLY_OPTIMAL,
+		// so write every level a view covers before sampling from it.
+		std::future<void> upload_image(VkImage dst, uint32_t mip_level, VkExtent2D extent, const void* data, VkDeviceSize size,
+			uint32_t layers = 1);
+		// Writes a region of an image that stays in VK_IMAGE_LAYOUT_GENERAL, frames
+		// may keep sampling other regions of it meanwhile
+		std::future<void> upload_image_region(VkImage dst, uint32_t mip_level, VkOffset2D offset, VkExtent2D extent,
+			const void* data, VkDeviceSize size);
+
+		// Records queued uploads until max_bytes, at least one so large uploads make
+		// progress. Returns VK_NULL_HANDLE when nothing was queued, otherwise the
+		// command buffer must be submitted and passed to submitted().
+		VkCommandBuffer record(VkDeviceSize max_bytes);
+		void submitted(uint64_t value);
+		// Fulfills the futures of batches up to completed_value. Returns the value
+		// of the last batch it completed, 0 when none did.
+		uint64_t collect(uint64_t completed_value);
+
+		// Nothing queued or in flight
+		bool idle() const;
+
+	private:
+		static const VkDeviceSize PAGE_SIZE = 256 * 1024;
+
+		struct Page {
+			Buffer buffer;
+			VkDeviceSize head = 0;
+			uint32_t pending = 0; // Queued uploads reading from the page
+			uint64_t value = 0; // Transfer timeline value of the last batch reading from it
+			bool dedicated = false; // Holds a single large upload and is destroyed after it
+			bool free = false;
+		};
+
+		struct Request {
+			uint32_t page;
+			VkDeviceSize src_offset;
+			VkBuffer dst = VK_NULL_HANDLE;
+			VkDeviceSize dst_offset = 0;
+			VkImage image = VK_NULL_HANDLE; // Set instead of dst for image uploads
+			uint32_t mip_level = 0;
+			VkOffset2D offset = { 0, 0 };
+			VkExtent2D extent = { 0, 0 };
+			uint32_t layers = 1;
+			bool in_place = false; // GENERAL layout, no transitions
+			VkDeviceSize size;
+			std::promise<void> promise;
+		};
+
+		struct Batch {
+			VkCommandBuffer command_buffer;
+			uint64_t value = 0; // 0 until submitted
+			std::vector<uint32_t> pages;
+			std::vector<std::promise<void>> promises;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		Allocator* allocator = nullptr;
+		VkCommandPool command_pool = VK_NULL_HANDLE;
+
+		mutable std::mutex mutex;
+		std::vector<Page> pages; // Destroyed pages leave an empty slot
+		std::vector<uint32_t> free_pages;
+		uint32_t open_page = UINT32_MAX; // Page small uploads are appended to
+		std::deque<Request> queue;
+		std::vector<Batch> batches;
+
+		uint32_t create_page(VkDeviceSize size, bool dedicated);
+		std::future<void> queue_request(Request& request, const void* data);
+		void record_image_copy(VkCommandBuffer command_buffer, const Request& request);
+	};
+
+}
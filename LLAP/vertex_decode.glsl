@@ -0,0 +1,28 @@
+// Decodes attributes of meshes written by quantize_mesh(). Declare the inputs
+// with the float types, the vertex fetch already normalizes UNORM, SNORM and
+// half float formats:
+//     layout(location = 0) in vec4 in_position;
+//     layout(location = 1) in vec2 in_normal;
+//     layout(location = 2) in vec2 in_uv;
+
+// position_offset and position_scale of the mesh. Apply it before the model
+// transform, normals must not see the non-uniform scale.
+vec3 decode_position(vec4 position, vec3 offset, vec3 scale) {
+	return offset + position.xyz * scale;
+}
+
+// Octahedral unit vector, both SNORM sizes
+vec3 decode_direction(vec2 encoded) {
+	vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	if (direction.z < 0.0) {
+		// Not sign(), zero folds to the positive side like the encoder
+		vec2 signs = vec2(encoded.x >= 0.0 ? 1.0 : -1.0, encoded.y >= 0.0 ? 1.0 : -1.0);
+		direction.xy = (1.0 - abs(encoded.yx)) * signs;
+	}
+	return normalize(direction);
+}
+
+// xyz is the tangent, w the bitangent sign
+vec4 decode_tangent(vec4 encoded) {
+	return vec4(decode_direction(encoded.xy), encoded.w < 0.0 ? -1.0 : 1.0);
+}
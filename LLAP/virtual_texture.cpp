@@ -0,0 +1,477 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace LLAP {
+
+	// Atlas coordinates are 12 bits in a page table entry
+	static const uint32_t MAX_ATLAS_PAGES = 4096;
+
+	void VirtualTextureCache::init(VkDevice device, Allocator* allocator, Uploader* uploader, BindlessTable* bindless,
+		const std::vector<uint32_t>& families, VkFormat format, uint32_t page_size, uint32_t border,
+		uint32_t atlas_pages, uint32_t max_pages, uint32_t frame_count, uint32_t thread_count)
+	{
+		this->device = device;
+		this->allocator = allocator;
+		this->uploader = uploader;
+		this->bindless = bindless;
+		this->atlas_pages = std::min(atlas_pages, MAX_ATLAS_PAGES);
+		this->max_pages = max_pages;
+
+		if (!layout.init(format, { page_size, page_size }, page_size, border)) {
+			log("Virtual texture pages of " + std::to_string(page_size) + " texels don't fit the format's blocks", ERROR);
+		}
+		if (this->atlas_pages == 0) {
+			log("Virtual texture atlas needs at least one page", ERROR);
+		}
+
+		uint32_t atlas_size = this->atlas_pages * layout.padded_size();
+		atlas = create_image(device, *allocator, { atlas_size, atlas_size }, 1, format,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, MEMORY_TEXTURE, families);
+
+		// Pages carry their own borders, filtering never leaves the slot
+		VkSamplerCreateInfo sampler_info{};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_LINEAR;
+		sampler_info.minFilter = VK_FILTER_LINEAR;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.minLod = 0.0f;
+		sampler_info.maxLod = 0.0f;
+
+		if (vkCreateSampler(device, &sampler_info, host_callbacks(HOST_SCOPE_DEVICE), &sampler) != VK_SUCCESS) {
+			log("Failed to create virtual texture sampler", ERROR);
+		}
+
+		atlas_index = bindless->add_texture(atlas.view, VK_IMAGE_LAYOUT_GENERAL);
+		sampler_index = bindless->add_sampler(sampler);
+
+		uint32_t entries = HEADER_WORDS + MAX_TEXTURES * RECORD_WORDS;
+		table.assign(entries + max_pages, NOT_RESIDENT);
+		table[0] = layout.page_size;
+		table[1] = layout.border;
+		table[2] = this->atlas_pages;
+		table[3] = entries;
+
+		// Only the graphics queue touches these
+		VkDeviceSize feedback_size = sizeof(uint32_t) * ((max_pages + 31) / 32);
+		frames.resize(frame_count);
+		for (auto& frame : frames) {
+			frame.table = create_buffer(device, *allocator, sizeof(uint32_t) * table.size(),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_DYNAMIC);
+			frame.feedback = create_buffer(device, *allocator, feedback_size,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MEMORY_DYNAMIC);
+			frame.readback = create_buffer(device, *allocator, feedback_size,
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MEMORY_STAGING);
+			frame.table_index = bindless->add_storage_buffer(frame.table.buffer);
+			frame.feedback_index = bindless->add_storage_buffer(frame.feedback.buffer);
+			frame.version = 0;
+			frame.feedback_written = false;
+		}
+
+		slots.assign(this->atlas_pages * this->atlas_pages, Slot());
+		free_slots.clear();
+		for (uint32_t i = static_cast<uint32_t>(slots.size()); i > 0; i--) {
+			free_slots.push_back(i - 1);
+		}
+
+		workers.start(thread_count, [this] { stream(); });
+	}
+
+	void VirtualTextureCache::cleanup() {
+		workers.stop();
+		uploaded.clear();
+		loading.clear();
+
+		for (auto& frame : frames) {
+			destroy_buffer(device, *allocator, frame.table);
+			destroy_buffer(device, *allocator, frame.feedback);
+			destroy_buffer(device, *allocator, frame.readback);
+		}
+		frames.clear();
+		textures.clear();
+
+		destroy_image(device, *allocator, atlas);
+		vkDestroySampler(device, sampler, host_callbacks(HOST_SCOPE_DEVICE));
+		sampler = VK_NULL_HANDLE;
+	}
+
+	void VirtualTextureCache::record_init(VkCommandBuffer command_buffer) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = atlas.image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+
+	uint32_t VirtualTextureCache::add(const std::string& path) {
+		auto file = std::unique_ptr<VirtualTextureFile>(new VirtualTextureFile(path));
+		const VirtualTextureLayout& file_layout = file->get_layout();
+
+		if (file_layout.format != layout.format || file_layout.page_size != layout.page_size || file_layout.border != layout.border) {
+			log("Virtual texture " + path + " has another format or page layout than the cache", ERROR);
+		}
+		if (file_layout.level_count > MAX_LEVELS || textures.size() >= MAX_TEXTURES) {
+			log("Too many virtual textures or levels: " + path, ERROR);
+		}
+		if (page_slots.size() + file_layout.page_count() > max_pages) {
+			log("Virtual texture " + path + " doesn't fit the page table", ERROR);
+		}
+		if (free_slots.empty()) {
+			log("No atlas slot left for virtual texture " + path, ERROR);
+		}
+
+		uint32_t id = static_cast<uint32_t>(textures.size());
+		uint32_t first_page = static_cast<uint32_t>(page_slots.size());
+		page_textures.resize(first_page + file_layout.page_count(), id);
+		page_slots.resize(page_textures.size(), NO_SLOT);
+		page_requested.resize(page_textures.size(), 0);
+
+		uint32_t* record = table.data() + HEADER_WORDS + id * RECORD_WORDS;
+		record[0] = file_layout.extent.width;
+		record[1] = file_layout.extent.height;
+		record[2] = file_layout.level_count;
+		record[3] = first_page;
+		for (uint32_t level = 0; level < file_layout.level_count; level++) {
+			record[4 + level] = file_layout.first_page(level);
+		}
+		version++;
+
+		textures.push_back({ std::move(file), first_page });
+
+		// Every other page falls back to the single page level
+		uint32_t slot = free_slots.back();
+		free_slots.pop_back();
+		slots[slot].pinned = true;
+		load(first_page + file_layout.page_count() - 1, slot);
+
+		return id;
+	}
+
+	void VirtualTextureCache::stream() {
+		std::vector<char> page(static_cast<size_t>(layout.page_bytes));
+		VkExtent2D extent = { layout.padded_size(), layout.padded_size() };
+
+		Job job;
+		while (workers.pop(job)) {
+			// Reading the mapping may block on disk, do it here rather than under the uploader's lock
+			std::memcpy(page.data(), job.data, page.size());
+			std::future<void> upload = uploader->upload_image_region(atlas.image, 0, slot_offset(job.slot), extent,
+				page.data(), layout.page_bytes);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			uploaded.push_back({ job.slot, std::move(upload) });
+		}
+	}
+
+	void VirtualTextureCache::load(uint32_t page, uint32_t slot) {
+		Slot& entry = slots[slot];
+		entry.state = SLOT_LOADING;
+		entry.page = page;
+		entry.last_used = frame_number;
+		page_slots[page] = slot;
+
+		const Texture& texture = textures[page_textures[page]];
+		workers.push({ texture.file->page(page - texture.first_page), slot });
+	}
+
+	bool VirtualTextureCache::begin_frame(uint32_t frame, uint32_t max_pages, uint64_t submitted_value, uint64_t completed_value) {
+		frame_number++;
+		Frame& current = frames[frame];
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& entry : uploaded) {
+				loading.push_back(std::move(entry));
+			}
+			uploaded.clear();
+		}
+
+		// Pages whose upload completed appear in this frame's page table
+		bool arrived = false;
+		for (size_t i = 0; i < loading.size();) {
+			if (loading[i].upload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				i++;
+				continue;
+			}
+
+			Slot& slot = slots[loading[i].slot];
+			slot.state = SLOT_RESIDENT;
+			refresh(slot.page);
+			version++;
+			arrived = true;
+
+			loading[i] = std::move(loading.back());
+			loading.pop_back();
+		}
+
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			if (slots[i].state == SLOT_RETIRED && slots[i].retire_value <= completed_value) {
+				slots[i].state = SLOT_FREE;
+				free_slots.push_back(i);
+			}
+		}
+
+		// The slot's previous frame completed, so its feedback copy did too
+		if (current.feedback_written) {
+			const uint32_t* words = static_cast<const uint32_t*>(current.readback.allocation.mapped);
+			uint32_t word_count = static_cast<uint32_t>((page_slots.size() + 31) / 32);
+			for (uint32_t i = 0; i < word_count; i++) {
+				uint32_t bits = words[i];
+				for (uint32_t bit = 0; bits != 0; bit++, bits >>= 1) {
+					if ((bits & 1) != 0 && i * 32 + bit < page_slots.size()) {
+						request(i * 32 + bit);
+					}
+				}
+			}
+		}
+		current.feedback_written = true;
+
+		// Coarser pages first, finer ones are useless until their ancestors arrived
+		std::stable_sort(requests.begin(), requests.end(), [&](uint32_t a, uint32_t b) {
+			return level_of(a) > level_of(b);
+		});
+
+		// Only queued pages count, evictions whose slots are still in use are bounded separately
+		uint32_t started = 0;
+		uint32_t evicted = 0;
+		for (uint32_t page : requests) {
+			if (started >= max_pages) {
+				break;
+			}
+
+			// Evicted slots are only free once the frames that may sample them completed
+			if (free_slots.empty()) {
+				if (evicted >= max_pages || !evict(submitted_value, completed_value)) {
+					break;
+				}
+				evicted++;
+				if (free_slots.empty()) {
+					continue;
+				}
+			}
+
+			uint32_t slot = free_slots.back();
+			free_slots.pop_back();
+			load(page, slot);
+			started++;
+		}
+		requests.clear();
+
+		if (current.version != version) {
+			uint32_t words = HEADER_WORDS + MAX_TEXTURES * RECORD_WORDS + static_cast<uint32_t>(page_slots.size());
+			std::memcpy(current.table.allocation.mapped, table.data(), sizeof(uint32_t) * words);
+			current.version = version;
+		}
+		return arrived;
+	}
+
+	void VirtualTextureCache::request(uint32_t page) {
+		// Ancestors are kept as fallbacks, so they count as used too
+		while (page != NO_PAGE && page_requested[page] != frame_number) {
+			page_requested[page] = frame_number;
+
+			uint32_t slot = page_slots[page];
+			if (slot != NO_SLOT) {
+				slots[slot].last_used = frame_number;
+			}
+			else {
+				requests.push_back(page);
+			}
+
+			page = parent(page);
+		}
+	}
+
+	bool VirtualTextureCache::evict(uint64_t submitted_value, uint64_t completed_value) {
+		uint32_t victim = NO_SLOT;
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			const Slot& slot = slots[i];
+			if (slot.state != SLOT_RESIDENT || slot.pinned || slot.last_used >= frame_number) {
+				continue;
+			}
+			if (victim == NO_SLOT || slot.last_used < slots[victim].last_used) {
+				victim = i;
+			}
+		}
+		if (victim == NO_SLOT) {
+			return false;
+		}
+
+		Slot& slot = slots[victim];
+		page_slots[slot.page] = NO_SLOT;
+		refresh(slot.page);
+		version++;
+
+		slot.page = NO_PAGE;
+		if (submitted_value <= completed_value) {
+			slot.state = SLOT_FREE;
+			free_slots.push_back(victim);
+		}
+		else {
+			slot.state = SLOT_RETIRED;
+			slot.retire_value = submitted_value;
+		}
+		return true;
+	}
+
+	void VirtualTextureCache::refresh(uint32_t page) {
+		const Texture& texture = textures[page_textures[page]];
+		const VirtualTextureLayout& file_layout = texture.file->get_layout();
+		uint32_t level = level_of(page);
+		uint32_t entries = HEADER_WORDS + MAX_TEXTURES * RECORD_WORDS;
+
+		uint32_t slot = page_slots[page];
+		if (slot != NO_SLOT && slots[slot].state == SLOT_RESIDENT) {
+			table[entries + page] = entry(slot, level);
+		}
+		else {
+			uint32_t ancestor = parent(page);
+			table[entries + page] = ancestor != NO_PAGE ? table[entries + ancestor] : NOT_RESIDENT;
+		}
+
+		if (level == 0) {
+			return;
+		}
+
+		// Children without a page of their own fall back to this one
+		uint32_t index = page - texture.first_page - file_layout.first_page(level);
+		uint32_t x = index % file_layout.pages_x(level);
+		uint32_t y = index / file_layout.pages_x(level);
+		uint32_t child_first = texture.first_page + file_layout.first_page(level - 1);
+		uint32_t child_pages_x = file_layout.pages_x(level - 1);
+		uint32_t child_pages_y = file_layout.pages_y(level - 1);
+
+		for (uint32_t child_y = y * 2; child_y < std::min(y * 2 + 2, child_pages_y); child_y++) {
+			for (uint32_t child_x = x * 2; child_x < std::min(x * 2 + 2, child_pages_x); child_x++) {
+				uint32_t child = child_first + child_y * child_pages_x + child_x;
+				uint32_t child_slot = page_slots[child];
+				if (child_slot == NO_SLOT || slots[child_slot].state != SLOT_RESIDENT) {
+					refresh(child);
+				}
+			}
+		}
+	}
+
+	uint32_t VirtualTextureCache::parent(uint32_t page) const {
+		const Texture& texture = textures[page_textures[page]];
+		const VirtualTextureLayout& file_layout = texture.file->get_layout();
+		uint32_t level = level_of(page);
+		if (level + 1 >= file_layout.level_count) {
+			return NO_PAGE;
+		}
+
+		uint32_t index = page - texture.first_page - file_layout.first_page(level);
+		uint32_t x = index % file_layout.pages_x(level);
+		uint32_t y = index / file_layout.pages_x(level);
+		return texture.first_page + file_layout.first_page(level + 1) + (y / 2) * file_layout.pages_x(level + 1) + x / 2;
+	}
+
+	uint32_t VirtualTextureCache::level_of(uint32_t page) const {
+		const Texture& texture = textures[page_textures[page]];
+		const VirtualTextureLayout& file_layout = texture.file->get_layout();
+		uint32_t level = 0;
+		while (level + 1 < file_layout.level_count && page - texture.first_page >= file_layout.first_page(level + 1)) {
+			level++;
+		}
+		return level;
+	}
+
+	uint32_t VirtualTextureCache::entry(uint32_t slot, uint32_t level) const {
+		return (slot % atlas_pages) | ((slot / atlas_pages) << 12) | (level << 24);
+	}
+
+	VkOffset2D VirtualTextureCache::slot_offset(uint32_t slot) const {
+		int32_t padded = static_cast<int32_t>(layout.padded_size());
+		return { static_cast<int32_t>(slot % atlas_pages) * padded, static_cast<int32_t>(slot / atlas_pages) * padded };
+	}
+
+	void VirtualTextureCache::record_clear(VkCommandBuffer command_buffer, uint32_t frame) {
+		const Frame& current = frames[frame];
+		vkCmdFillBuffer(command_buffer, current.feedback.buffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = current.feedback.buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 1, &barrier, 0, nullptr);
+	}
+
+	void VirtualTextureCache::record_readback(VkCommandBuffer command_buffer, uint32_t frame) {
+		const Frame& current = frames[frame];
+
+		VkBufferMemoryBarrier barriers[2]{};
+		barriers[0].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].buffer = current.feedback.buffer;
+		barriers[0].offset = 0;
+		barriers[0].size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 1, &barriers[0], 0, nullptr);
+
+		VkBufferCopy region{};
+		region.srcOffset = 0;
+		region.dstOffset = 0;
+		region.size = current.feedback.size;
+		vkCmdCopyBuffer(command_buffer, current.feedback.buffer, current.readback.buffer, 1, &region);
+
+		barriers[1] = barriers[0];
+		barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		barriers[1].buffer = current.readback.buffer;
+
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &barriers[1], 0, nullptr);
+	}
+
+	VirtualTextureBindings VirtualTextureCache::get_bindings(uint32_t frame) const {
+		VirtualTextureBindings bindings;
+		bindings.atlas = atlas_index;
+		bindings.sampler = sampler_index;
+		bindings.table = frames[frame].table_index;
+		bindings.feedback = frames[frame].feedback_index;
+		return bindings;
+	}
+
+	const VirtualTextureLayout& VirtualTextureCache::get_layout() const {
+		return layout;
+	}
+
+	uint32_t VirtualTextureCache::resident_pages() const {
+		uint32_t count = 0;
+		for (const auto& slot : slots) {
+			count += slot.state == SLOT_RESIDENT ? 1 : 0;
+		}
+		return count;
+	}
+
+}
@@ -0,0 +1,66 @@
+// Samples virtual textures of a VirtualTextureCache from fragment shaders.
+// Declare the bindless set before including it:
+//     layout(set = 1, binding = 0) uniform sampler samplers[];
+//     layout(set = 1, binding = 1) buffer Words { uint words[]; } buffers[];
+//     layout(set = 1, binding = 2) uniform texture2D textures[];
+
+// Must match VirtualTextureCache
+const uint VT_HEADER_WORDS = 4;
+const uint VT_RECORD_WORDS = 20;
+const uint VT_NOT_RESIDENT = 0xFFFFFFFFu;
+
+// VirtualTextureCache::get_bindings of the frame slot
+struct VirtualTextureBindings {
+	uint atlas;
+	uint sampler;
+	uint table;
+	uint feedback;
+};
+
+vec4 vt_sample(VirtualTextureBindings vt, uint texture_id, vec2 uv) {
+	uint page_size = buffers[vt.table].words[0];
+	uint border = buffers[vt.table].words[1];
+	uint atlas_pages = buffers[vt.table].words[2];
+	uint entries = buffers[vt.table].words[3];
+
+	uint record = VT_HEADER_WORDS + texture_id * VT_RECORD_WORDS;
+	uvec2 extent = uvec2(buffers[vt.table].words[record], buffers[vt.table].words[record + 1]);
+	uint level_count = buffers[vt.table].words[record + 2];
+	uint first_page = buffers[vt.table].words[record + 3];
+
+	uv = clamp(uv, vec2(0.0), vec2(1.0));
+	vec2 texel = uv * vec2(extent);
+	float lod = log2(max(max(length(dFdx(texel)), length(dFdy(texel))), 1.0));
+	uint level = min(uint(lod), level_count - 1);
+
+	uvec2 level_extent = max(extent >> level, uvec2(1));
+	uvec2 pages = (level_extent + page_size - 1) / page_size;
+	uvec2 page = min(uvec2(uv * vec2(level_extent)) / page_size, pages - 1);
+	uint index = first_page + buffers[vt.table].words[record + 4 + level] + page.y * pages.x + page.x;
+
+	// Only the first pixels asking for a page pay for the atomic
+	uint word = index / 32;
+	uint bit = 1u << (index % 32);
+	if ((buffers[vt.feedback].words[word] & bit) == 0) {
+		atomicOr(buffers[vt.feedback].words[word], bit);
+	}
+
+	uint entry = buffers[vt.table].words[entries + index];
+	if (entry == VT_NOT_RESIDENT) {
+		return vec4(0.0);
+	}
+
+	// The entry may hold an ancestor, it covers this texel at a coarser level.
+	// Rounding of odd level sizes can put the texel a little outside of it, the
+	// border still has the right texels there.
+	uint resident = entry >> 24;
+	uvec2 slot = uvec2(entry & 0xFFF, (entry >> 12) & 0xFFF);
+	uvec2 resident_page = page >> (resident - level);
+	vec2 resident_texel = uv * vec2(max(extent >> resident, uvec2(1)));
+	vec2 local = clamp(resident_texel - vec2(resident_page * page_size),
+		vec2(0.5 - float(border)), vec2(float(page_size + border) - 0.5));
+
+	uint padded = page_size + border * 2;
+	vec2 atlas_texel = vec2(slot * padded + border) + local;
+	return textureLod(sampler2D(textures[vt.atlas], samplers[vt.sampler]), atlas_texel / float(atlas_pages * padded), 0.0);
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <future>
+#include <mutex>
+#include <memory>
+
+#include "debug.h"
+#include "allocator.h"
+#include "buffer.h"
+#include "image.h"
+#include "upload.h"
+#include "bindless.h"
+#include "worker_pool.h"
+#include "vtex.h"
+
+namespace LLAP {
+
+	// Bindless indices a shader needs to sample the cache in one frame slot,
+	// see virtual_texture.glsl
+	struct VirtualTextureBindings {
+		uint32_t atlas = BindlessTable::INVALID_INDEX;
+		uint32_t sampler = BindlessTable::INVALID_INDEX;
+		uint32_t table = BindlessTable::INVALID_INDEX;
+		uint32_t feedback = BindlessTable::INVALID_INDEX;
+	};
+
+	// Virtual textures share one atlas of fixed size whose slots hold their
+	// resident pages. Shaders find a page through a page table and record the
+	// pages they wanted in a feedback bitset, read back by the frame slot's next
+	// frame. Missing pages are sampled from their nearest resident ancestor until
+	// they arrive, coarser pages load first and the least recently used ones are
+	// evicted, so device memory stays constant however large the textures are.
+	//
+	// The page table is a storage buffer per frame slot rather than an
+	// indirection image, it's rewritten from the CPU copy when it changed. Every
+	// texture of the cache has the page layout and format the cache was created
+	// with.
+	class VirtualTextureCache {
+	public:
+		static const uint32_t MAX_TEXTURES = 256;
+		static const uint32_t MAX_LEVELS = 16;
+
+		// atlas_pages is the atlas' size in pages per side and at least one, max_pages bounds the
+		// pages of all textures together.
+		void init(VkDevice device, Allocator* allocator, Uploader* uploader, BindlessTable* bindless,
+			const std::vector<uint32_t>& families, VkFormat format, uint32_t page_size, uint32_t border,
+			uint32_t atlas_pages, uint32_t max_pages, uint32_t frame_count, uint32_t thread_count);
+		// The device must be idle
+		void cleanup();
+
+		// Moves the atlas to GENERAL, where it stays. Submit it before the first
+		// frame that samples the cache.
+		void record_init(VkCommandBuffer command_buffer);
+
+		// Maps the file and queues its single page level, the texture samples as
+		// zero until that arrived. Like every other method, only call it from the
+		// render thread.
+		uint32_t add(const std::string& path);
+
+		// Once per frame, after the frame slot's previous frame completed. Reads
+		// that frame's feedback, queues up to max_pages of the pages it asked for
+		// and publishes the page table to the slot. submitted_value is the
+		// graphics timeline value of the last submitted frame. Returns true when
+		// pages arrived, the frame must then wait on the transfer queue.
+		bool begin_frame(uint32_t frame, uint32_t max_pages, uint64_t submitted_value, uint64_t completed_value);
+
+		// Before and after the render pass of every frame that samples the cache
+		void record_clear(VkCommandBuffer command_buffer, uint32_t frame);
+		void record_readback(VkCommandBuffer command_buffer, uint32_t frame);
+
+		VirtualTextureBindings get_bindings(uint32_t frame) const;
+		const VirtualTextureLayout& get_layout() const;
+		uint32_t resident_pages() const;
+
+	private:
+		static const uint32_t NO_SLOT = UINT32_MAX;
+		static const uint32_t NO_PAGE = UINT32_MAX;
+		// Page table entries pack the atlas slot's x and y in 12 bits each and the
+		// level of the page it holds in the top 8, pages without an ancestor are this
+		static const uint32_t NOT_RESIDENT = UINT32_MAX;
+		// Words of the table header and of each texture's record, must match virtual_texture.glsl
+		static const uint32_t HEADER_WORDS = 4;
+		static const uint32_t RECORD_WORDS = 4 + MAX_LEVELS;
+
+		typedef enum SLOT_STATE {
+			SLOT_FREE,
+			SLOT_LOADING,
+			SLOT_RESIDENT,
+			SLOT_RETIRED, // Evicted, frames up to retire_value may still sample it
+		} SLOT_STATE;
+
+		struct Slot {
+			SLOT_STATE state = SLOT_FREE;
+			uint32_t page = NO_PAGE;
+			uint64_t last_used = 0;
+			uint64_t retire_value = 0;
+			bool pinned = false; // Single page levels are never evicted
+		};
+
+		struct Texture {
+			std::unique_ptr<VirtualTextureFile> file;
+			uint32_t first_page = 0;
+		};
+
+		struct Job {
+			const char* data;
+			uint32_t slot;
+		};
+
+		struct Loading {
+			uint32_t slot;
+			std::future<void> upload;
+		};
+
+		// Per frame slot
+		struct Frame {
+			Buffer table;
+			Buffer feedback;
+			Buffer readback;
+			uint32_t table_index = BindlessTable::INVALID_INDEX;
+			uint32_t feedback_index = BindlessTable::INVALID_INDEX;
+			uint64_t version = 0; // Of the table last copied in
+			bool feedback_written = false;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		Allocator* allocator = nullptr;
+		Uploader* uploader = nullptr;
+		BindlessTable* bindless = nullptr;
+		VirtualTextureLayout layout;
+		uint32_t atlas_pages = 0;
+		uint32_t max_pages = 0;
+
+		Image atlas;
+		VkSampler sampler = VK_NULL_HANDLE;
+		uint32_t atlas_index = BindlessTable::INVALID_INDEX;
+		uint32_t sampler_index = BindlessTable::INVALID_INDEX;
+		std::vector<Frame> frames;
+
+		std::vector<Texture> textures;
+		std::vector<uint32_t> table; // CPU copy of the page table
+		uint64_t version = 1;
+		std::vector<uint32_t> page_textures;
+		std::vector<uint32_t> page_slots;
+		std::vector<uint64_t> page_requested; // Frame of the last request, to skip duplicates
+		std::vector<Slot> slots;
+		std::vector<uint32_t> free_slots;
+		std::vector<Loading> loading;
+		std::vector<uint32_t> requests; // Reused every frame
+		uint64_t frame_number = 0;
+
+		WorkerPool<Job> workers;
+		// Shared with the streaming threads
+		std::mutex mutex;
+		std::vector<Loading> uploaded;
+
+		void stream();
+		void request(uint32_t page);
+		void load(uint32_t page, uint32_t slot);
+		bool evict(uint64_t submitted_value, uint64_t completed_value);
+		void refresh(uint32_t page);
+		uint32_t parent(uint32_t page) const;
+		uint32_t level_of(uint32_t page) const;
+		uint32_t entry(uint32_t slot, uint32_t level) const;
+		VkOffset2D slot_offset(uint32_t slot) const;
+	};
+
+}
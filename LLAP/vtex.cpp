@@ -0,0 +1,180 @@
+#include "vtex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace LLAP {
+
+	static const char VTEX_MAGIC[4] = { 'L', 'L', 'V', 'T' };
+	static const uint32_t VTEX_VERSION = 1;
+	// Pages start on a file system page so the first one touched maps alone
+	static const uint64_t VTEX_DATA_OFFSET = 4096;
+
+	// File layout, all little endian
+	struct VtexHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vk_format;
+		uint32_t width;
+		uint32_t height;
+		uint32_t page_size;
+		uint32_t border;
+		uint32_t level_count;
+		uint64_t page_bytes;
+		uint64_t data_offset;
+	};
+
+	static_assert(sizeof(VtexHeader) == 48, "vtex header must match the file layout");
+
+	bool VirtualTextureLayout::init(VkFormat format, VkExtent2D extent, uint32_t page_size, uint32_t border) {
+		FormatBlock block;
+		if (!format_block(format, block) || page_size == 0 || extent.width == 0 || extent.height == 0 ||
+			page_size % block.width != 0 || page_size % block.height != 0 ||
+			border % block.width != 0 || border % block.height != 0 ||
+			page_size > MAX_PADDED_SIZE || border > (MAX_PADDED_SIZE - page_size) / 2)
+		{
+			return false;
+		}
+
+		this->format = format;
+		this->extent = extent;
+		this->page_size = page_size;
+		this->border = border;
+
+		level_count = 1;
+		while (std::max(mip_extent(extent, level_count - 1).width, mip_extent(extent, level_count - 1).height) > page_size) {
+			level_count++;
+		}
+
+		page_bytes = level_size(block, { padded_size(), padded_size() });
+		return true;
+	}
+
+	uint32_t VirtualTextureLayout::padded_size() const {
+		return page_size + border * 2;
+	}
+
+	uint32_t VirtualTextureLayout::pages_x(uint32_t level) const {
+		return (mip_extent(extent, level).width + page_size - 1) / page_size;
+	}
+
+	uint32_t VirtualTextureLayout::pages_y(uint32_t level) const {
+		return (mip_extent(extent, level).height + page_size - 1) / page_size;
+	}
+
+	uint32_t VirtualTextureLayout::first_page(uint32_t level) const {
+		uint32_t first = 0;
+		for (uint32_t i = 0; i < level; i++) {
+			first += pages_x(i) * pages_y(i);
+		}
+		return first;
+	}
+
+	uint32_t VirtualTextureLayout::page_count() const {
+		return first_page(level_count);
+	}
+
+	VirtualTextureFile::VirtualTextureFile(const std::string& path) {
+		file = std::make_shared<const MappedFile>(path);
+
+		VtexHeader header;
+		if (file->size() < sizeof(header)) {
+			log("Not a vtex file: " + path, ERROR);
+		}
+		std::memcpy(&header, file->data(), sizeof(header));
+
+		if (std::memcmp(header.magic, VTEX_MAGIC, sizeof(VTEX_MAGIC)) != 0 || header.version != VTEX_VERSION) {
+			log("Not a vtex file: " + path, ERROR);
+		}
+		if (!layout.init(static_cast<VkFormat>(header.vk_format), { header.width, header.height }, header.page_size, header.border) ||
+			layout.level_count != header.level_count || layout.page_bytes != header.page_bytes)
+		{
+			log("Corrupt vtex header: " + path, ERROR);
+		}
+
+		data_offset = header.data_offset;
+		if (data_offset > file->size() || layout.page_bytes * layout.page_count() > file->size() - data_offset) {
+			log("Truncated vtex file: " + path, ERROR);
+		}
+	}
+
+	const VirtualTextureLayout& VirtualTextureFile::get_layout() const {
+		return layout;
+	}
+
+	const char* VirtualTextureFile::page(uint32_t index) const {
+		return file->data() + data_offset + layout.page_bytes * index;
+	}
+
+	void write_vtex(const std::string& path, const TextureData& data, uint32_t page_size, uint32_t border) {
+		VirtualTextureLayout layout;
+		FormatBlock block;
+		if (!layout.init(data.format, data.extent, page_size, border) || !format_block(data.format, block)) {
+			log("Can't cut the texture into pages of " + std::to_string(page_size) + " texels", ERROR);
+		}
+		if (data.level_count() < layout.level_count) {
+			log("The texture needs " + std::to_string(layout.level_count) + " levels to be virtual", ERROR);
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			log("Failed to open file", ERROR);
+		}
+
+		VtexHeader header{};
+		std::memcpy(header.magic, VTEX_MAGIC, sizeof(VTEX_MAGIC));
+		header.version = VTEX_VERSION;
+		header.vk_format = static_cast<uint32_t>(layout.format);
+		header.width = layout.extent.width;
+		header.height = layout.extent.height;
+		header.page_size = layout.page_size;
+		header.border = layout.border;
+		header.level_count = layout.level_count;
+		header.page_bytes = layout.page_bytes;
+		header.data_offset = VTEX_DATA_OFFSET;
+
+		std::vector<char> page(static_cast<size_t>(layout.page_bytes));
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(page.data(), VTEX_DATA_OFFSET - sizeof(header));
+
+		// Everything is whole blocks, compressed formats are cut without decoding
+		int32_t page_blocks_x = static_cast<int32_t>(layout.padded_size() / block.width);
+		int32_t page_blocks_y = static_cast<int32_t>(layout.padded_size() / block.height);
+		int32_t border_blocks_x = static_cast<int32_t>(border / block.width);
+		int32_t border_blocks_y = static_cast<int32_t>(border / block.height);
+		size_t block_bytes = block.bytes;
+
+		for (uint32_t level = 0; level < layout.level_count; level++) {
+			VkExtent2D extent = mip_extent(layout.extent, level);
+			int32_t blocks_x = static_cast<int32_t>((extent.width + block.width - 1) / block.width);
+			int32_t blocks_y = static_cast<int32_t>((extent.height + block.height - 1) / block.height);
+			const char* source = data.level_data(level);
+
+			for (uint32_t y = 0; y < layout.pages_y(level); y++) {
+				for (uint32_t x = 0; x < layout.pages_x(level); x++) {
+					int32_t origin_x = static_cast<int32_t>((x * page_size) / block.width) - border_blocks_x;
+					int32_t origin_y = static_cast<int32_t>((y * page_size) / block.height) - border_blocks_y;
+
+					char* dst = page.data();
+					for (int32_t row = 0; row < page_blocks_y; row++) {
+						int32_t source_y = std::min(std::max(origin_y + row, 0), blocks_y - 1);
+						for (int32_t column = 0; column < page_blocks_x; column++) {
+							int32_t source_x = std::min(std::max(origin_x + column, 0), blocks_x - 1);
+							std::memcpy(dst, source + (static_cast<size_t>(source_y) * blocks_x + source_x) * block_bytes, block_bytes);
+							dst += block_bytes;
+						}
+					}
+
+					file.write(page.data(), page.size());
+				}
+			}
+		}
+
+		if (!file) {
+			log("Failed to write " + path, ERROR);
+		}
+	}
+
+}
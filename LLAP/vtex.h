@@ -0,0 +1,64 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <memory>
+
+#include "debug.h"
+#include "io.h"
+#include "image.h"
+#include "texture.h"
+
+namespace LLAP {
+
+	// How a virtual texture is cut into pages. Every level is split into square
+	// pages of page_size texels, each stored with border texels of its
+	// neighbours on every side so bilinear and anisotropic filtering within a
+	// page never reads the atlas slot next to it. Levels stop at the first one
+	// that fits a single page.
+	struct VirtualTextureLayout {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = { 0, 0 };
+		uint32_t page_size = 0;
+		uint32_t border = 0;
+		uint32_t level_count = 0;
+		VkDeviceSize page_bytes = 0; // One page including its border
+
+		// Largest page including its border, the largest 2D image every device supports
+		static const uint32_t MAX_PADDED_SIZE = 4096;
+
+		// False when the format is unknown, page_size and border aren't whole blocks
+		// or a padded page is larger than MAX_PADDED_SIZE
+		bool init(VkFormat format, VkExtent2D extent, uint32_t page_size, uint32_t border);
+
+		uint32_t padded_size() const;
+		uint32_t pages_x(uint32_t level) const;
+		uint32_t pages_y(uint32_t level) const;
+		// Pages are numbered level by level, finest first, in rows
+		uint32_t first_page(uint32_t level) const;
+		uint32_t page_count() const;
+	};
+
+	// A .vtex file, the header followed by every page of the layout in order.
+	// Pages are copied from the mapping straight into staging, only the pages
+	// that are ever requested are read from disk.
+	class VirtualTextureFile {
+	public:
+		explicit VirtualTextureFile(const std::string& path);
+
+		const VirtualTextureLayout& get_layout() const;
+		const char* page(uint32_t index) const;
+
+	private:
+		std::shared_ptr<const MappedFile> file;
+		VirtualTextureLayout layout;
+		VkDeviceSize data_offset = 0;
+	};
+
+	// Cuts data into pages, it needs every level down to the single page one.
+	// Texels outside a level repeat its edge.
+	void write_vtex(const std::string& path, const TextureData& data, uint32_t page_size = 128, uint32_t border = 4);
+
+}
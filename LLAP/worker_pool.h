@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+
+namespace LLAP {
+
+	// Background threads taking jobs in the order they were pushed. Every thread
+	// runs worker, which loops on pop() until it returns false.
+	template<typename Job>
+	class WorkerPool {
+	public:
+		void start(uint32_t thread_count, std::function<void()> worker) {
+			stopping = false;
+			for (uint32_t i = 0; i < std::max(thread_count, 1u); i++) {
+				threads.emplace_back(worker);
+			}
+		}
+
+		// Drops the jobs no thread took yet and joins the threads
+		void stop() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+				jobs.clear();
+			}
+			work.notify_all();
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			threads.clear();
+		}
+
+		void push(Job job) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				jobs.push_back(std::move(job));
+			}
+			work.notify_one();
+		}
+
+		// Blocks until there is a job, false once the pool is stopping
+		bool pop(Job& job) {
+			std::unique_lock<std::mutex> lock(mutex);
+			work.wait(lock, [&] { return stopping || !jobs.empty(); });
+			if (stopping) {
+				return false;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			return true;
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable work;
+		std::deque<Job> jobs;
+		bool stopping = false;
+		std::vector<std::thread> threads;
+	};
+
+}